@@ -1,28 +1,301 @@
 #!/usr/bin/env python3
 import argparse
+import fcntl
+import glob
+import os
 import re
+import struct
 import sys
 import time
 from collections import namedtuple
+from contextlib import ExitStack
 from math import floor, ceil
 from queue import Queue
+from types import SimpleNamespace
 
-import pygame
-import pygame.font
-import evdev
-from evdev import ecodes
+try:
+    import evdev
+    from evdev import ecodes
+except ImportError:
+    # headless replay only needs the event codes, allow running without python-evdev
+    evdev = None
+    ecodes = SimpleNamespace(EV_SYN=0x00, EV_KEY=0x01, EV_ABS=0x03, SYN_REPORT=0,
+                             ABS_X=0x00, ABS_Y=0x01, BTN_LEFT=0x110, BTN_TRIGGER=0x120)
 
 import logging
 
+pygame = None
+
 log = logging.getLogger("guncon2-calibration")
 
 Postion = namedtuple("Postion", ["x", "y"])
+AbsInfo = namedtuple("AbsInfo", ["value", "min", "max", "fuzz", "flat", "resolution"])
+InputEvent = namedtuple("InputEvent", ["sec", "usec", "type", "code", "value"])
+Shot = namedtuple("Shot", ["seq", "timestamp", "x", "y", "spread_x", "spread_y", "samples"])
+RecordedShot = namedtuple("RecordedShot", ["read_time", "shot"])
+
+CAPTURE_HEADER = "# guncon2 capture v1"
+
+EVIOCSCLOCKID = 0x400445a0
+
+# struct guncon2_shot from guncon2.h, positions in 1/16 raw units
+GUNCON2_SHOT = struct.Struct("=QIIIIII")
+GUNCON2_SHOT_SCALE = 16.0
+
+# a driver shot belongs to the pull whose evdev timestamp is this close to its edge
+SHOT_MATCH_NS = 50_000_000
+# give up on the driver and use the evdev position after this long, well past its 8 field capture
+SHOT_TIMEOUT_NS = 400_000_000
+# Guncon2.shot() result while the driver is still collecting samples
+PENDING = object()
+
+
+def event_time(ev):
+    return ev.sec * 1_000_000_000 + ev.usec * 1000
+
+
+class ReplayDevice(object):
+    """
+    Stand-in for evdev.InputDevice that plays back a recorded capture.
+
+    Capture files are plain text, one record per line:
+      absinfo <code> <min> <max>
+      event <sec>.<usec> <type> <code> <value>
+      shot <read_ns> <seq> <timestamp_ns> <x> <y> <spread_x> <spread_y> <samples>
+
+    Shot records are the driver shots the live session read from /dev/guncon2-N;
+    they become available again once the replay reaches their read time.
+    """
+
+    def __init__(self, path):
+        self.path = path
+        self.name = "Namco GunCon 2"
+        self._absinfo = {}
+        self._events = []
+        self._next = 0
+        self._shots = []
+        self._next_shot = 0
+        self._now = 0
+        with open(path) as f:
+            for lineno, line in enumerate(f, 1):
+                fields = line.split()
+                if not fields or fields[0].startswith("#"):
+                    continue
+                try:
+                    if fields[0] == "absinfo":
+                        code, min_, max_ = (int(v) for v in fields[1:4])
+                        self._absinfo[code] = AbsInfo(0, min_, max_, 0, 0, 0)
+                    elif fields[0] == "event":
+                        sec, _, usec = fields[1].partition(".")
+                        type_, code, value = (int(v) for v in fields[2:5])
+                        self._events.append(InputEvent(int(sec), int(usec or 0), type_, code, value))
+                    elif fields[0] == "shot":
+                        read_time, seq, timestamp = (int(v) for v in fields[1:4])
+                        x, y, spread_x, spread_y = (float(v) for v in fields[4:8])
+                        shot = Shot(seq, timestamp, x, y, spread_x, spread_y, int(fields[8]))
+                        self._shots.append(RecordedShot(read_time, shot))
+                    else:
+                        raise ValueError(fields[0])
+                except ValueError:
+                    raise ValueError(f"{path}:{lineno}: malformed capture record")
+        self._initial_absinfo = dict(self._absinfo)
+        self._shots.sort(key=lambda recorded: recorded.read_time)
+
+    @property
+    def done(self):
+        return self._next >= len(self._events)
+
+    def absinfo(self, code):
+        return self._absinfo[code]
+
+    def set_absinfo(self, code, min=None, max=None):
+        info = self._absinfo[code]
+        self._absinfo[code] = info._replace(min=info.min if min is None else min,
+                                            max=info.max if max is None else max)
+
+    @property
+    def has_shots(self):
+        return bool(self._shots)
+
+    def rewind(self):
+        self._next = 0
+        self._next_shot = 0
+        self._now = 0
+        self._absinfo = dict(self._initial_absinfo)
+
+    def read_one(self):
+        if self.done:
+            return None
+        ev = self._events[self._next]
+        self._next += 1
+        self._now = event_time(ev)
+        return ev
+
+    def now(self):
+        """Replay clock: the timestamp of the last event read."""
+        return self._now
+
+    def read_shot(self):
+        """Next recorded driver shot, once the replay has reached the time it was read."""
+        if self._next_shot >= len(self._shots) or self._shots[self._next_shot].read_time > self._now:
+            return None
+        self._next_shot += 1
+        return self._shots[self._next_shot - 1].shot
+
+    @property
+    def next_time(self):
+        ev = self._events[self._next]
+        return ev.sec, ev.usec
+
+    def read_packet(self):
+        """Return the events up to and including the next SYN_REPORT."""
+        packet = []
+        while True:
+            ev = self.read_one()
+            if ev is None:
+                return packet
+            packet.append(ev)
+            if ev.type == ecodes.EV_SYN and ev.code == ecodes.SYN_REPORT:
+                return packet
+
+
+class CaptureWriter(object):
+    """Record a live device to a capture file that ReplayDevice can play back."""
+
+    def __init__(self, path, device):
+        self.file = open(path, "w")
+        self.file.write(CAPTURE_HEADER + "\n")
+        for code in (ecodes.ABS_X, ecodes.ABS_Y):
+            info = device.absinfo(code)
+            self.file.write(f"absinfo {code} {info.min} {info.max}\n")
+
+    def write(self, ev):
+        self.file.write(f"event {ev.sec}.{ev.usec:06d} {ev.type} {ev.code} {ev.value}\n")
+
+    def write_shot(self, read_time, shot):
+        self.file.write("shot {} {} {} {:.4f} {:.4f} {:.4f} {:.4f} {}\n".format(read_time, *shot))
+
+    def close(self):
+        self.file.close()
+
+
+class DriverShots(object):
+    """Reads the shots the driver aggregates for each trigger pull from /dev/guncon2-N, without blocking."""
+
+    def __init__(self, sysfs, node):
+        self.sysfs = sysfs
+        self.fd = os.open(node, os.O_RDONLY | os.O_NONBLOCK)
+
+    def enable(self, enable):
+        with open(os.path.join(self.sysfs, "calib_capture"), "w") as f:
+            f.write("1" if enable else "0")
+
+    def read_shot(self):
+        try:
+            data = os.read(self.fd, GUNCON2_SHOT.size)
+        except BlockingIOError:
+            return None
+        timestamp, seq, x, y, spread_x, spread_y, samples = GUNCON2_SHOT.unpack(data)
+        return Shot(seq, timestamp, x / GUNCON2_SHOT_SCALE, y / GUNCON2_SHOT_SCALE,
+                    spread_x / GUNCON2_SHOT_SCALE, spread_y / GUNCON2_SHOT_SCALE, samples)
+
+    def close(self):
+        os.close(self.fd)
+
+    @staticmethod
+    def now():
+        # evdev timestamps are switched to CLOCK_MONOTONIC, the clock of the shot timestamps
+        return time.clock_gettime_ns(time.CLOCK_MONOTONIC)
 
 
 class Guncon2(object):
-    def __init__(self, device):
+    def __init__(self, device, capture=None, linked=()):
         self.device = device
+        # other input devices of the same gun, which get the same calibration
+        self.linked = list(linked)
+        self.capture = capture
         self.pos = Postion(0, 0)
+        # source of driver shots, and the shots read from it but not matched to a pull yet
+        self.driver = None
+        self.shots = []
+
+        # the driver's calibration capture lives on the USB interface, two levels up,
+        # the shots are read from the gun's character device
+        path = getattr(device, "path", "")
+        if path.startswith("/dev/input/"):
+            sysfs = os.path.join("/sys/class/input", os.path.basename(path), "device", "device")
+            nodes = glob.glob(os.path.join(sysfs, "misc", "guncon2-*"))
+            if os.path.exists(os.path.join(sysfs, "calib_capture")) and nodes:
+                try:
+                    self.driver = DriverShots(sysfs, os.path.join("/dev", os.path.basename(nodes[0])))
+                except OSError as err:
+                    log.warning(f"Driver calibration capture unavailable: {err}")
+        elif getattr(device, "has_shots", False):
+            self.driver = device
+
+    def driver_capture(self, enable):
+        """Switch the driver's per-shot sample aggregation on or off, if available."""
+        if not isinstance(self.driver, DriverShots):
+            return False
+        try:
+            self.driver.enable(enable)
+            if not enable:
+                self.driver.close()
+                self.driver = None
+            else:
+                # match the shot timestamps, which the driver takes from CLOCK_MONOTONIC
+                fcntl.ioctl(self.device.fd, EVIOCSCLOCKID, struct.pack("i", time.CLOCK_MONOTONIC))
+        except OSError as err:
+            log.warning(f"Driver calibration capture unavailable: {err}")
+            self.driver = None
+            return False
+        return True
+
+    def poll_shots(self):
+        """Collect the shots the driver has finished so far."""
+        while self.driver is not None:
+            try:
+                shot = self.driver.read_shot()
+            except OSError as err:
+                log.warning(f"Driver shot unavailable: {err}")
+                self.driver = None
+                return
+            if shot is None:
+                return
+            if self.capture:
+                self.capture.write_shot(self.driver.now(), shot)
+            self.shots.append(shot)
+
+    def drain_shots(self):
+        """Forget the shots of every pull so far."""
+        self.poll_shots()
+        self.shots = []
+
+    def shot(self, trigger, fallback):
+        """
+        Driver-aggregated position of the pull at evdev time trigger (ns).
+
+        Returns PENDING while the driver is still collecting samples, None when
+        it saw no light for the pull, and the fallback without driver capture.
+        """
+        if self.driver is None:
+            return fallback
+        self.poll_shots()
+        # the driver queues one shot per pull, earlier ones belong to pulls that were not used
+        match = [shot for shot in self.shots if abs(shot.timestamp - trigger) <= SHOT_MATCH_NS]
+        if match:
+            shot = min(match, key=lambda shot: abs(shot.timestamp - trigger))
+            self.shots = self.shots[self.shots.index(shot) + 1:]
+            log.info(f"Driver shot {shot.seq}: ({shot.x}, {shot.y}) "
+                     f"spread=({shot.spread_x}, {shot.spread_y}) samples={shot.samples}")
+            if not shot.samples:
+                log.warning("The driver saw no light for the shot")
+                return None
+            return shot.x, shot.y
+        if self.driver.now() - trigger > SHOT_TIMEOUT_NS:
+            log.warning("No shot from the driver, using the last reported position")
+            return fallback
+        return PENDING
 
     @property
     def absinfo(self):
@@ -53,21 +326,42 @@ class Guncon2(object):
     def normalise(pos, min_, max_):
         return (pos - min_) / float(max_ - min_)
 
+    def handle(self, ev):
+        if self.capture:
+            self.capture.write(ev)
+        if ev.type == ecodes.EV_ABS:
+            if ev.code == ecodes.ABS_X:
+                self.pos = Postion(ev.value, self.pos.y)
+            elif ev.code == ecodes.ABS_Y:
+                self.pos = Postion(self.pos.x, ev.value)
+        if ev.type == ecodes.EV_KEY:
+            return ev.code, ev.value
+
+    def triggered(self, key):
+        return key is not None and key[0] in (ecodes.BTN_LEFT, ecodes.BTN_TRIGGER) and key[1] == 1
+
+    def packets(self, events):
+        """
+        Split events into (position, trigger) pairs, one per SYN_REPORT packet;
+        trigger is the timestamp of a pull in the packet (ns) or None.
+        """
+        trigger = None
+        for ev in events:
+            if self.triggered(self.handle(ev)):
+                trigger = event_time(ev)
+            if ev.type == ecodes.EV_SYN and ev.code == ecodes.SYN_REPORT:
+                yield self.pos, trigger
+                trigger = None
+
     def update(self):
-        while True:
-            ev = self.device.read_one()
-            if ev:
-                if ev.type == ecodes.EV_ABS:
-                    if ev.code == ecodes.ABS_X:
-                        self.pos = Postion(ev.value, self.pos.y)
-                    elif ev.code == ecodes.ABS_Y:
-                        self.pos = Postion(self.pos.x, ev.value)
-                if ev.type == ecodes.EV_KEY:
-                    yield ev.code, ev.value
-            else:
-                break
+        # linked devices are grabbed to hide the calibration from other clients, keep them drained
+        for device in self.linked:
+            while device.read_one() is not None:
+                pass
+        return self.packets(iter(self.device.read_one, None))
 
-    def calibrate(self, targets, shots, width=320, height=240):
+    @staticmethod
+    def fit(targets, shots, width=320, height=240):
         targets_x = [target[0] for target in targets]
         targets_y = [target[1] for target in targets]
         shots_x = [shot[0] for shot in shots]
@@ -82,7 +376,7 @@ class Guncon2(object):
         try:
             gsratio_y = (max(targets_y) - min(targets_y)) / (max(shots_y) - min(shots_y))
         except ZeroDivisionError:
-            log.error("Failed to calibrate X axis")
+            log.error("Failed to calibrate Y axis")
             return
 
         min_x = min(shots_x) - (min(targets_x) * gsratio_x)
@@ -91,11 +385,21 @@ class Guncon2(object):
         min_y = min(shots_y) - (min(targets_y) * gsratio_y)
         max_y = max(shots_y) + ((height - max(targets_y)) * gsratio_y)
 
+        return int(min_x), int(max_x), int(min_y), int(max_y)
+
+    def calibrate(self, targets, shots, width=320, height=240):
+        fitted = self.fit(targets, shots, width, height)
+        if fitted is None:
+            return
+        min_x, max_x, min_y, max_y = fitted
+
         # set the X and Y calibration values
-        self.device.set_absinfo(ecodes.ABS_X, min=int(min_x), max=int(max_x))
-        self.device.set_absinfo(ecodes.ABS_Y, min=int(min_y), max=int(max_y))
+        for device in [self.device] + self.linked:
+            device.set_absinfo(ecodes.ABS_X, min=min_x, max=max_x)
+            device.set_absinfo(ecodes.ABS_Y, min=min_y, max=max_y)
 
         log.info(f"Calibration: x=({self.absinfo[0]}) y=({self.absinfo[1]})")
+        return fitted
 
 
 WIDTH = 320
@@ -103,19 +407,89 @@ HEIGHT = 240
 TARGET_SIZE = 20
 WHITE = (255, 255, 255)
 GREY = (128, 128, 128)
+PLAYER_COLORS = [(255, 255, 0), (255, 80, 80), (80, 160, 255), (80, 255, 80)]
 
 STATE_START = 0
 STATE_TARGET = 1
-STATE_DONE = 3
 
+TARGETS = [(50, 50), (320 - 50, 50), (320 - 50, 240 - 50), (50, 240 - 50)]
 
-def draw_target(size=10):
+
+class Calibration(object):
+    """Target/shot state machine, shared by the display and headless front-ends."""
+
+    def __init__(self, guncon, targets):
+        self.guncon = guncon
+        self.targets = targets
+        self.shots = [(0, 0)] * len(targets)
+        self.state = STATE_START
+        self.target_i = 0
+        self.result = None
+        self.results = []
+        # (trigger, position) of pulls on the current target still waiting for their driver shot
+        self.pending = []
+
+    @property
+    def target(self):
+        return self.targets[self.target_i]
+
+    def step(self, raw_pos, trigger):
+        raw_x, raw_y = raw_pos
+        if self.state == STATE_START:
+            if trigger is not None:
+                self.state = STATE_TARGET
+                self.target_i = 0
+                self.pending = []
+                # shots of pulls before the first target must not count for it
+                self.guncon.drain_shots()
+                log.info("Set target at: ({}, {})".format(*self.target))
+
+        elif self.state == STATE_TARGET:
+            if raw_x > 5 and trigger is not None:
+                self.pending.append((trigger, raw_pos))
+
+    def resolve(self):
+        """Assign the driver shots of the pending pulls to the targets, in order."""
+        while self.pending:
+            trigger, raw_pos = self.pending[0]
+            shot = self.guncon.shot(trigger, raw_pos)
+            if shot is PENDING:
+                return
+            self.pending.pop(0)
+            if shot is None:
+                continue
+            self.shots[self.target_i] = shot
+            self.target_i += 1
+            if self.target_i == len(self.targets):
+                self.pending = []
+                self.result = self.guncon.calibrate(self.targets, self.shots)
+                self.results.append(self.result)
+                self.state = STATE_START
+            else:
+                log.info("Set target at: ({}, {})".format(*self.target))
+
+    def feed(self, packets):
+        """
+        Step once per packet, a trigger pairs with the position of its own
+        packet, then take whatever driver shots are ready without blocking.
+        Returns the positions of the pulls.
+        """
+        pulls = []
+        for raw_pos, trigger in packets:
+            self.step(raw_pos, trigger)
+            if trigger is not None:
+                pulls.append(raw_pos)
+        self.resolve()
+        return pulls
+
+
+def draw_target(size=10, color=WHITE):
     image = pygame.Surface((size * 8, size * 8)).convert()
     mid = (size * 8) // 2
-    pygame.draw.circle(image, WHITE, (mid, mid), size * 4, 2)
+    pygame.draw.circle(image, color, (mid, mid), size * 4, 2)
 
-    pygame.draw.line(image, WHITE, (mid, mid - size), (mid, mid + size), 2)
-    pygame.draw.line(image, WHITE, (mid - size, mid), (mid + size, mid), 2)
+    pygame.draw.line(image, color, (mid, mid - size), (mid, mid + size), 2)
+    pygame.draw.line(image, color, (mid - size, mid), (mid + size, mid), 2)
 
     image.set_colorkey([0, 0, 0])
     return image
@@ -141,6 +515,64 @@ def blit_right(screen, image, pos):
     screen.blit(image, (pos[0] - (image.get_rect()[2]), pos[1]))
 
 
+def find_guns():
+    """Group the GunCon 2 input devices by physical gun, the mouse device first."""
+    guns = {}
+    for device in [evdev.InputDevice(path) for path in evdev.list_devices()]:
+        if device.name.startswith("Namco GunCon 2"):
+            guns.setdefault(device.phys, []).append(device)
+
+    def has_left_button(device):
+        return ecodes.BTN_LEFT in device.capabilities().get(ecodes.EV_KEY, [])
+
+    return [sorted(guns[phys], key=lambda device: not has_left_button(device)) for phys in sorted(guns)]
+
+
+def capture_path(path, player, players):
+    if players == 1:
+        return path
+    root, ext = os.path.splitext(path)
+    return f"{root}.p{player + 1}{ext}"
+
+
+def run_headless(paths, repeat=1):
+    """Replay one capture per gun through the calibration flow without a display."""
+    devices = [ReplayDevice(path) for path in paths]
+    runtimes = []
+    results = []
+
+    for _ in range(repeat):
+        guncons = []
+        calibrations = []
+        for device in devices:
+            device.rewind()
+            guncons.append(Guncon2(device))
+            calibrations.append(Calibration(guncons[-1], TARGETS))
+
+        start = time.perf_counter()
+        pending = [i for i, device in enumerate(devices) if not device.done]
+        while pending:
+            # interleave the guns in timestamp order, as they would arrive live
+            i = min(pending, key=lambda i: devices[i].next_time)
+            calibrations[i].feed(guncons[i].packets(devices[i].read_packet()))
+            if devices[i].done:
+                pending.remove(i)
+        runtimes.append(time.perf_counter() - start)
+        results = [calibration.results for calibration in calibrations]
+
+    for path, gun_results in zip(paths, results):
+        for result in gun_results:
+            if result is None:
+                print(f"{path}: calibration failed")
+            else:
+                print("{}: calibration x={}..{} y={}..{}".format(path, *result))
+    print(f"runtime runs={len(runtimes)} best={min(runtimes) * 1000:.3f}ms "
+          f"mean={sum(runtimes) / len(runtimes) * 1000:.3f}ms")
+
+    if not all(results) or any(None in gun_results for gun_results in results):
+        return 1
+
+
 def main():
     def point_type(value):
         m = re.match(r"\(?(\d+)\s*,\s*(\d+)\)?", value)
@@ -153,11 +585,20 @@ def main():
     parser.add_argument("-r", "--resolution", default="320x240")
     parser.add_argument("--center-target", default=(160, 120), type=point_type)
     parser.add_argument("--topleft-target", default=(50, 50), type=point_type)
-    parser.add_argument("--capture", default=None)
+    parser.add_argument("--capture", default=None,
+                        help="record the guns' events to this file (one per gun, name.pN.ext) for --replay")
+    parser.add_argument("--replay", default=None, nargs="+",
+                        help="run headless, calibrating one gun from each recorded capture")
+    parser.add_argument("--repeat", default=1, type=int,
+                        help="number of times to run the replay, for benchmarking")
     args = parser.parse_args()
 
     logging.basicConfig(level=logging.INFO)
 
+    if args.replay:
+        logging.getLogger().setLevel(logging.WARNING)
+        return run_headless(args.replay, max(args.repeat, 1))
+
     try:
         w, h = args.resolution.split("x")
         width, height = int(w), int(h)
@@ -165,20 +606,31 @@ def main():
         parser.error("Invalid resolution, eg. 320x240")
         return
 
-    guncon2_dev = None
-    # find the first guncon2
-    for device in [evdev.InputDevice(path) for path in evdev.list_devices()]:
-        if device.name == "Namco GunCon 2":
-            guncon2_dev = device
-            break
+    if evdev is None:
+        sys.stderr.write("python-evdev is required to calibrate a live GunCon2")
+        return 1
 
-    if guncon2_dev is None:
+    guns = find_guns()
+    if not guns:
         sys.stderr.write("Failed to find any attached GunCon2 devices")
         return 1
-
-    with guncon2_dev.grab_context():
-
-        guncon = Guncon2(guncon2_dev)
+    log.info(f"Found {len(guns)} GunCon2 device(s)")
+
+    # imported here so that headless replays don't need pygame or a display
+    global pygame
+    import pygame
+    import pygame.font
+
+    with ExitStack() as stack:
+        guncons = []
+        for player, devices in enumerate(guns):
+            for device in devices:
+                stack.enter_context(device.grab_context())
+            capture = None
+            if args.capture:
+                capture = CaptureWriter(capture_path(args.capture, player, len(guns)), devices[0])
+                stack.callback(capture.close)
+            guncons.append(Guncon2(devices[0], capture, devices[1:]))
 
         pygame.init()
         pygame.font.init()
@@ -192,13 +644,19 @@ def main():
         screen = pygame.display.set_mode((width, height), pygame.FULLSCREEN)
         clock = pygame.time.Clock()
 
-        state = STATE_START
         running = True
-        targets = [(50, 50), (320 - 50, 50), (320 - 50, 240 - 50), (50, 240 - 50)]
-        target_shots = [(0, 0), (0, 0), (0, 0), (0, 0)]
-
-        cursor = draw_cursor(color=(255, 255, 0))
-        target = draw_target()
+        calibrations = []
+        cursors = []
+        targets = []
+        labels = []
+        for player, guncon in enumerate(guncons):
+            color = PLAYER_COLORS[player % len(PLAYER_COLORS)]
+            calibrations.append(Calibration(guncon, TARGETS))
+            cursors.append(draw_cursor(color=color))
+            targets.append(draw_target(color=color))
+            labels.append(font.render(f"P{player + 1}", True, color))
+            if guncon.driver_capture(True):
+                stack.callback(guncon.driver_capture, False)
         onscreen_warning = 0
 
         while running:
@@ -208,48 +666,38 @@ def main():
 
             screen.fill((80, 80, 80))
 
-            raw_x, raw_y = guncon.pos
-            cx, cy = int(guncon.pos_normalised.x * width), int(guncon.pos_normalised.y * height)
-            trigger = False
-            for button, value in guncon.update():
-                if button == ecodes.BTN_LEFT and value == 1:
-                    trigger = True
-
-            raw_pos_txt = font.render(f"({raw_x}, {raw_y})", True, (128, 128, 255))
-            cal_pos_txt = font.render(f"({cx}, {cy})", True, (128, 128, 255))
-
-            screen.blit(raw_pos_txt, (20, height - 40))
-            blit_right(screen, cal_pos_txt, (width - 20, height - 40))
-
-            if state == STATE_START:
+            if any(calibration.state == STATE_START for calibration in calibrations):
                 screen.blit(start_text, ((width // 2) - start_text_w, height - 60))
-                if width > cx >= 0 and height > cy >= 0:  # on screen
-                    screen.blit(cursor, (cx, cy))
-                if trigger:
-                    state = STATE_TARGET
-                    target_i = 0
-                    log.info("Set target at: ({}, {})".format(*targets[target_i]))
-
-            elif state == STATE_TARGET:
-                blit_center(screen, target, targets[target_i])
-                if raw_x > 5 and trigger:
-                    target_shots[target_i] = (raw_x, raw_y)
-                    target_i += 1
-                    if target_i == len(targets):
-                        state = STATE_DONE
-                    else:
-                        log.info("Set target at: ({}, {})".format(*targets[target_i]))
-
-            elif state == STATE_DONE:
-                guncon.calibrate(targets, target_shots)
-                state = STATE_START
-
-            # only trigger off screen shot on target states
-            if raw_x < 5 and trigger and state != STATE_START:
-                onscreen_warning = time.time() + 1.0
 
-            if raw_x > 5 and trigger:
-                onscreen_warning = 0
+            # every gun is read and stepped each frame without blocking, so players calibrate concurrently
+            for player, (guncon, calibration) in enumerate(zip(guncons, calibrations)):
+                pulls = calibration.feed(guncon.update())
+                raw_x, raw_y = guncon.pos
+                cx, cy = int(guncon.pos_normalised.x * width), int(guncon.pos_normalised.y * height)
+
+                raw_pos_txt = font.render(f"P{player + 1} ({raw_x}, {raw_y})", True, (128, 128, 255))
+                cal_pos_txt = font.render(f"({cx}, {cy})", True, (128, 128, 255))
+
+                row = height - 40 - (len(guncons) - 1 - player) * 20
+                screen.blit(raw_pos_txt, (20, row))
+                blit_right(screen, cal_pos_txt, (width - 20, row))
+
+                if calibration.state == STATE_START:
+                    if width > cx >= 0 and height > cy >= 0:  # on screen
+                        screen.blit(cursors[player], (cx, cy))
+                elif calibration.state == STATE_TARGET:
+                    blit_center(screen, targets[player], calibration.target)
+                    # offset the labels so players on the same target stay readable
+                    tx, ty = calibration.target
+                    screen.blit(labels[player], (tx + 22, ty - 30 + player * 15))
+
+                for pull_x, _ in pulls:
+                    # only trigger off screen shot on target states
+                    if pull_x < 5 and calibration.state != STATE_START:
+                        onscreen_warning = time.time() + 1.0
+
+                    if pull_x > 5:
+                        onscreen_warning = 0
 
             if time.time() < onscreen_warning:
                 off_screen_txt = font.render("Warning: Shot Off-Screen", True, (255, 80, 80))
@@ -9,15 +9,32 @@
  *
  */
 #include <linux/bitops.h>
+#include <linux/debugfs.h>
 #include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/idr.h>
 #include <linux/input.h>
 #include <linux/kernel.h>
+#include <linux/kfifo.h>
+#include <linux/kref.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/miscdevice.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/spinlock.h>
 #include <linux/uaccess.h>
 #include <linux/usb.h>
 #include <linux/usb/input.h>
+#include <linux/wait.h>
+
+#include "guncon2.h"
 
 #define NAMCO_VENDOR_ID 0x0b9a
 #define GUNCON2_PRODUCT_ID 0x016a
@@ -41,6 +58,148 @@
 
 #define OFFSCREEN_HYST_FRAMES 8
 
+#define GUNCON2_REPORT_SIZE 6
+
+/*
+ * Threaded mode: the completion handler only queues the raw report, a
+ * SCHED_FIFO thread decodes it and reports the input events.
+ */
+#define THREAD_QUEUE 64
+
+enum guncon2_path {
+    GUNCON2_PATH_INLINE,
+    GUNCON2_PATH_THREADED,
+    GUNCON2_PATHS,
+};
+
+static const char *const guncon2_path_names[GUNCON2_PATHS] = {
+        [GUNCON2_PATH_INLINE] = "inline",
+        [GUNCON2_PATH_THREADED] = "threaded",
+};
+
+struct guncon2_report {
+    u64 timestamp_ns;
+    u8 data[GUNCON2_REPORT_SIZE];
+};
+
+/* completion to input_sync() latency of emitted reports */
+struct guncon2_latency {
+    u64 count;
+    u64 total_ns;
+    u64 max_ns;
+};
+
+/*
+ * Auto-ranging: track low/high quantiles (1/2^AUTORANGE_QUANTILE_SHIFT) of
+ * the observed raw coordinates and slowly widen the accepted window to
+ * cover them. The window never shrinks below the default calibration and
+ * never grows beyond the hard limits.
+ */
+#define AUTORANGE_X_LIMIT_MIN 100
+#define AUTORANGE_X_LIMIT_MAX 800
+#define AUTORANGE_Y_LIMIT_MIN 5
+#define AUTORANGE_Y_LIMIT_MAX 255
+#define AUTORANGE_QUANTILE_SHIFT 7
+#define AUTORANGE_FRAC_BITS 8
+#define AUTORANGE_MARGIN 4
+#define AUTORANGE_RATE 256
+
+/*
+ * Calibration capture: the gun measures one position per video field and
+ * repeats it in every 1 ms report, so a sample is taken when the valid
+ * position changes, or once per CAPTURE_FIELD_NS while it doesn't. On each
+ * trigger press the last CAPTURE_PRE samples before the edge and the ones
+ * following it are collected until CAPTURE_SAMPLES are available (or
+ * CAPTURE_TIMEOUT_FIELDS passed), then reduced to median and spread in 1/16
+ * raw units. Any invalid report empties the pre-edge history, so only an
+ * unbroken run of on-screen samples seeds a shot. Every press queues exactly
+ * one shot, tagged with a sequence number and the report time of the edge;
+ * a press without any valid samples (off screen) queues an empty shot and a
+ * press during a running capture finishes it early.
+ */
+#define CAPTURE_PRE 4
+#define CAPTURE_SAMPLES 8
+#define CAPTURE_FIELD_NS (20 * NSEC_PER_MSEC) /* 50 Hz, the longest field */
+#define CAPTURE_TIMEOUT_FIELDS 8
+#define CAPTURE_QUEUE 16
+
+/*
+ * Report decimation: the device is polled every 1 ms but only samples a new
+ * position once per video field. DECIMATE_CHANGE emits a packet only when
+ * the valid position changes (so at most one per field, none while the gun
+ * is still), a positive value caps the output rate in Hz. Button and
+ * offscreen edges are always emitted immediately.
+ */
+#define DECIMATE_OFF 0
+#define DECIMATE_CHANGE -1
+#define DECIMATE_MAX_HZ 1000
+
+/*
+ * Vsync resampling: vsync timestamps fed through /dev/guncon2-N are averaged
+ * into a period, and the reported position is extrapolated from the last two
+ * field samples to the next predicted vsync. Resampling stops when no vsync
+ * arrived for VSYNC_TIMEOUT_NS.
+ */
+#define VSYNC_TIMEOUT_NS (250 * NSEC_PER_MSEC)
+#define VSYNC_MAX_PERIOD_NS (100 * NSEC_PER_MSEC)
+#define VSYNC_MAX_FIELD_NS (100 * NSEC_PER_MSEC)
+#define VSYNC_MAX_EXTRAPOLATE_NS (40 * NSEC_PER_MSEC)
+
+/* light-quality heatmap over the raw coordinate space, see debugfs */
+#define HEATMAP_COLS 32
+#define HEATMAP_ROWS 16
+#define HEATMAP_X_SPAN 1024
+#define HEATMAP_Y_SPAN 256
+
+enum guncon2_sample {
+    GUNCON2_SAMPLE_VALID,
+    GUNCON2_SAMPLE_UNEXPECTED_LIGHT,
+    GUNCON2_SAMPLE_NO_LIGHT,
+    GUNCON2_SAMPLE_OUT_OF_RANGE,
+    GUNCON2_SAMPLE_KINDS,
+};
+
+static const char *const guncon2_sample_names[GUNCON2_SAMPLE_KINDS] = {
+        [GUNCON2_SAMPLE_VALID] = "valid",
+        [GUNCON2_SAMPLE_UNEXPECTED_LIGHT] = "unexpected_light",
+        [GUNCON2_SAMPLE_NO_LIGHT] = "no_light",
+        [GUNCON2_SAMPLE_OUT_OF_RANGE] = "out_of_range",
+};
+
+static struct dentry *guncon2_debugfs_root;
+
+static DEFINE_IDA(guncon2_ida);
+
+/*
+ * Per-gun character device: vsync feed through ioctl(), calibration shots
+ * through read(). Reference counted, since open files may outlive the USB
+ * interface.
+ */
+struct guncon2_cdev {
+    struct kref kref;
+    struct miscdevice misc;
+    char name[16];
+    int id;
+    bool disconnected;
+
+    /* vsync feed, see VSYNC_TIMEOUT_NS */
+    spinlock_t lock;
+    u64 last_ns;
+    u64 period_ns;
+
+    /* finished calibration shots, see CAPTURE_SAMPLES */
+    spinlock_t shots_lock;
+    wait_queue_head_t shots_wait;
+    DECLARE_KFIFO(shots, struct guncon2_shot, CAPTURE_QUEUE);
+};
+
+struct guncon2_range {
+    u16 x_min;
+    u16 x_max;
+    u16 y_min;
+    u16 y_max;
+};
+
 struct guncon2 {
     struct input_dev *js_input;
     struct input_dev *mouse_input;
@@ -53,6 +212,61 @@ struct guncon2 {
     u16 last_x;
     u16 last_y;
     bool have_last_pos;
+    int offscreen_frames;
+    int last_buttons;
+    bool last_offscreen;
+
+    /* report decimation, see DECIMATE_CHANGE */
+    int decimate;
+    u16 decimate_x;
+    u16 decimate_y;
+    ktime_t next_emit;
+
+    struct guncon2_cdev *cdev;
+
+    /* last two field samples for vsync resampling, oldest first */
+    u64 field_ns[2];
+    u16 field_px[2];
+    u16 field_py[2];
+    unsigned int field_count;
+
+    /* accepted raw window, adapted when auto-ranging is enabled */
+    struct guncon2_range range;
+    bool autorange;
+    bool autorange_reset;
+    u32 quantile_x_lo;
+    u32 quantile_x_hi;
+    u32 quantile_y_lo;
+    u32 quantile_y_hi;
+    unsigned int autorange_samples;
+
+    /* threaded processing, see THREAD_QUEUE */
+    bool threaded;
+    struct task_struct *thread;
+    wait_queue_head_t thread_wait;
+    wait_queue_head_t drain_wait;
+    DECLARE_KFIFO(reports, struct guncon2_report, THREAD_QUEUE);
+    unsigned long reports_dropped;
+    struct guncon2_latency latency[GUNCON2_PATHS];
+
+    /* per-cell sample counts, invalid reports land in the last valid cell */
+    u32 heatmap[GUNCON2_SAMPLE_KINDS][HEATMAP_ROWS][HEATMAP_COLS];
+
+    /* calibration capture, see CAPTURE_SAMPLES */
+    bool capture_enabled;
+    bool capture_active;
+    unsigned int capture_count;
+    u32 capture_seq;
+    u64 capture_ns;
+    u16 sample_x;
+    u16 sample_y;
+    u64 sample_ns;
+    u16 capture_x[CAPTURE_SAMPLES];
+    u16 capture_y[CAPTURE_SAMPLES];
+    u16 history_x[CAPTURE_PRE];
+    u16 history_y[CAPTURE_PRE];
+    unsigned int history_head;
+    unsigned int history_count;
 };
 
 struct gc_mode {
@@ -63,20 +277,528 @@ struct gc_mode {
     unsigned char mode;
 };
 
-static void guncon2_usb_irq(struct urb *urb)
+static int guncon2_cmp_u32(const void *a, const void *b)
+{
+    u32 x = *(const u32 *) a;
+    u32 y = *(const u32 *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* median of n fixed point values, sorts the array in place */
+static u32 guncon2_median(u32 *v, unsigned int n)
+{
+    sort(v, n, sizeof(*v), guncon2_cmp_u32, NULL);
+    if (n & 1)
+        return v[n / 2];
+    return (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* median and median absolute deviation of n raw samples, in fixed point */
+static void guncon2_reduce(const u16 *raw, unsigned int n, u32 *median, u32 *spread)
+{
+    u32 v[CAPTURE_SAMPLES];
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+        v[i] = (u32) raw[i] << GUNCON2_SHOT_FRAC_BITS;
+    *median = guncon2_median(v, n);
+
+    for (i = 0; i < n; i++)
+        v[i] = abs((s32) v[i] - (s32) *median);
+    *spread = guncon2_median(v, n);
+}
+
+static void guncon2_capture_finish(struct guncon2 *guncon2)
+{
+    struct guncon2_shot shot = {
+        .timestamp_ns = guncon2->capture_ns,
+        .seq = guncon2->capture_seq,
+        .samples = guncon2->capture_count,
+    };
+
+    guncon2->capture_active = false;
+    if (guncon2->capture_count) {
+        guncon2_reduce(guncon2->capture_x, guncon2->capture_count,
+                       &shot.x, &shot.spread_x);
+        guncon2_reduce(guncon2->capture_y, guncon2->capture_count,
+                       &shot.y, &shot.spread_y);
+    }
+
+    /* drop the shot rather than block if the tool isn't reading */
+    kfifo_in_spinlocked(&guncon2->cdev->shots, &shot, 1,
+                        &guncon2->cdev->shots_lock);
+    wake_up_interruptible(&guncon2->cdev->shots_wait);
+}
+
+/*
+ * Feed one report into the calibration capture. Runs in the report
+ * processing path only, so the capture state itself needs no locking; the
+ * queue of finished shots is shared with the character device and protected
+ * by shots_lock.
+ */
+static void guncon2_capture(struct guncon2 *guncon2, u16 raw_x, u16 raw_y,
+                            bool valid, bool trigger_edge, u64 timestamp_ns)
+{
+    unsigned int i, idx;
+    bool sample;
+
+    if (!READ_ONCE(guncon2->capture_enabled)) {
+        guncon2->capture_active = false;
+        guncon2->history_count = 0;
+        guncon2->sample_ns = 0;
+        return;
+    }
+
+    /* one sample per field: on a new position, or a field after the last one */
+    sample = valid && (raw_x != guncon2->sample_x || raw_y != guncon2->sample_y ||
+                       timestamp_ns - guncon2->sample_ns >= CAPTURE_FIELD_NS);
+    if (sample) {
+        guncon2->sample_x = raw_x;
+        guncon2->sample_y = raw_y;
+        guncon2->sample_ns = timestamp_ns;
+    } else if (!valid) {
+        /* samples from before the gun left the screen are stale */
+        guncon2->history_count = 0;
+        guncon2->sample_ns = 0;
+    }
+
+    if (trigger_edge) {
+        if (guncon2->capture_active)
+            guncon2_capture_finish(guncon2);
+
+        /* seed with the valid samples just before the edge, oldest first */
+        for (i = 0; i < guncon2->history_count; i++) {
+            idx = (guncon2->history_head + CAPTURE_PRE -
+                   guncon2->history_count + i) % CAPTURE_PRE;
+            guncon2->capture_x[i] = guncon2->history_x[idx];
+            guncon2->capture_y[i] = guncon2->history_y[idx];
+        }
+        guncon2->capture_count = guncon2->history_count;
+        guncon2->capture_seq++;
+        guncon2->capture_ns = timestamp_ns;
+        guncon2->capture_active = true;
+    }
+
+    if (sample) {
+        guncon2->history_x[guncon2->history_head] = raw_x;
+        guncon2->history_y[guncon2->history_head] = raw_y;
+        guncon2->history_head = (guncon2->history_head + 1) % CAPTURE_PRE;
+        if (guncon2->history_count < CAPTURE_PRE)
+            guncon2->history_count++;
+    }
+
+    if (!guncon2->capture_active)
+        return;
+
+    if (sample) {
+        guncon2->capture_x[guncon2->capture_count] = raw_x;
+        guncon2->capture_y[guncon2->capture_count] = raw_y;
+        guncon2->capture_count++;
+    }
+
+    if (guncon2->capture_count == CAPTURE_SAMPLES ||
+        timestamp_ns - guncon2->capture_ns >=
+                CAPTURE_TIMEOUT_FIELDS * CAPTURE_FIELD_NS)
+        guncon2_capture_finish(guncon2);
+}
+
+static void guncon2_autorange_reset(struct guncon2 *guncon2)
+{
+    guncon2->quantile_x_lo = X_MIN << AUTORANGE_FRAC_BITS;
+    guncon2->quantile_x_hi = X_MAX << AUTORANGE_FRAC_BITS;
+    guncon2->quantile_y_lo = Y_MIN << AUTORANGE_FRAC_BITS;
+    guncon2->quantile_y_hi = Y_MAX << AUTORANGE_FRAC_BITS;
+    guncon2->autorange_samples = 0;
+    WRITE_ONCE(guncon2->range.x_min, X_MIN);
+    WRITE_ONCE(guncon2->range.x_max, X_MAX);
+    WRITE_ONCE(guncon2->range.y_min, Y_MIN);
+    WRITE_ONCE(guncon2->range.y_max, Y_MAX);
+}
+
+/*
+ * Streaming quantile estimate in fixed point: step down by (1 - q) raw units
+ * when the sample is below the estimate and up by q otherwise, which settles
+ * where a fraction q of the samples lies below it.
+ */
+static void guncon2_quantile(u32 *est, u16 sample, bool high)
+{
+    const u32 unit = 1 << AUTORANGE_FRAC_BITS;
+    const u32 tail = unit >> AUTORANGE_QUANTILE_SHIFT;
+    u32 v = (u32) sample << AUTORANGE_FRAC_BITS;
+
+    if (v < *est)
+        *est -= min(*est - v, high ? tail : unit - tail);
+    else
+        *est += high ? unit - tail : tail;
+}
+
+/* move one raw unit towards target */
+static u16 guncon2_approach(u16 cur, int target)
+{
+    if (cur < target)
+        return cur + 1;
+    if (cur > target)
+        return cur - 1;
+    return cur;
+}
+
+static void guncon2_autorange(struct guncon2 *guncon2, u16 raw_x, u16 raw_y)
+{
+    struct guncon2_range *range = &guncon2->range;
+    int lo, hi;
+
+    if (raw_x < AUTORANGE_X_LIMIT_MIN || raw_x > AUTORANGE_X_LIMIT_MAX ||
+        raw_y < AUTORANGE_Y_LIMIT_MIN || raw_y > AUTORANGE_Y_LIMIT_MAX)
+        return;
+
+    guncon2_quantile(&guncon2->quantile_x_lo, raw_x, false);
+    guncon2_quantile(&guncon2->quantile_x_hi, raw_x, true);
+    guncon2_quantile(&guncon2->quantile_y_lo, raw_y, false);
+    guncon2_quantile(&guncon2->quantile_y_hi, raw_y, true);
+
+    if (++guncon2->autorange_samples < AUTORANGE_RATE)
+        return;
+    guncon2->autorange_samples = 0;
+
+    lo = (guncon2->quantile_x_lo >> AUTORANGE_FRAC_BITS) - AUTORANGE_MARGIN;
+    hi = (guncon2->quantile_x_hi >> AUTORANGE_FRAC_BITS) + AUTORANGE_MARGIN;
+    WRITE_ONCE(range->x_min, guncon2_approach(range->x_min,
+                                              clamp(lo, AUTORANGE_X_LIMIT_MIN, X_MIN)));
+    WRITE_ONCE(range->x_max, guncon2_approach(range->x_max,
+                                              clamp(hi, X_MAX, AUTORANGE_X_LIMIT_MAX)));
+
+    lo = (guncon2->quantile_y_lo >> AUTORANGE_FRAC_BITS) - AUTORANGE_MARGIN;
+    hi = (guncon2->quantile_y_hi >> AUTORANGE_FRAC_BITS) + AUTORANGE_MARGIN;
+    WRITE_ONCE(range->y_min, guncon2_approach(range->y_min,
+                                              clamp(lo, AUTORANGE_Y_LIMIT_MIN, Y_MIN)));
+    WRITE_ONCE(range->y_max, guncon2_approach(range->y_max,
+                                              clamp(hi, Y_MAX, AUTORANGE_Y_LIMIT_MAX)));
+}
+
+static void guncon2_heatmap_add(struct guncon2 *guncon2, enum guncon2_sample kind)
+{
+    unsigned int col, row;
+
+    if (!guncon2->have_last_pos)
+        return;
+
+    col = min_t(unsigned int, guncon2->last_x, HEATMAP_X_SPAN - 1) *
+          HEATMAP_COLS / HEATMAP_X_SPAN;
+    row = min_t(unsigned int, guncon2->last_y, HEATMAP_Y_SPAN - 1) *
+          HEATMAP_ROWS / HEATMAP_Y_SPAN;
+    guncon2->heatmap[kind][row][col]++;
+}
+
+/* Decide whether this report is emitted or folded into the next one */
+static bool guncon2_decimate(struct guncon2 *guncon2, u16 raw_x, u16 raw_y,
+                             bool valid, int buttons, bool offscreen)
+{
+    int mode = READ_ONCE(guncon2->decimate);
+    bool changed = false;
+    ktime_t now;
+
+    /* invalid codes leave the reported position alone, only compare valid ones */
+    if (valid) {
+        changed = raw_x != guncon2->decimate_x || raw_y != guncon2->decimate_y;
+        guncon2->decimate_x = raw_x;
+        guncon2->decimate_y = raw_y;
+    }
+
+    if (mode == DECIMATE_OFF)
+        return true;
+    if (buttons != guncon2->last_buttons || offscreen != guncon2->last_offscreen)
+        return true;
+    if (mode == DECIMATE_CHANGE)
+        return changed;
+
+    now = ktime_get();
+    if (ktime_before(now, guncon2->next_emit))
+        return false;
+    guncon2->next_emit = ktime_add_ns(now, NSEC_PER_SEC / mode);
+    return true;
+}
+
+static void guncon2_field_sample(struct guncon2 *guncon2, u16 x, u16 y, u64 ts)
+{
+    if (guncon2->field_count &&
+        guncon2->field_px[1] == x && guncon2->field_py[1] == y)
+        return;
+
+    guncon2->field_ns[0] = guncon2->field_ns[1];
+    guncon2->field_px[0] = guncon2->field_px[1];
+    guncon2->field_py[0] = guncon2->field_py[1];
+    guncon2->field_ns[1] = ts;
+    guncon2->field_px[1] = x;
+    guncon2->field_py[1] = y;
+    if (guncon2->field_count < 2)
+        guncon2->field_count++;
+}
+
+static u16 guncon2_extrapolate(u16 p0, u16 p1, s64 dt, s64 span, u16 lo, u16 hi)
+{
+    return clamp_t(s64, p1 + div64_s64((s64) (p1 - p0) * dt, span), lo, hi);
+}
+
+/* Resample the reported position to the consumer's next vsync, if it feeds one */
+static void guncon2_resample(struct guncon2 *guncon2, u16 *x, u16 *y)
+{
+    struct guncon2_cdev *cdev = guncon2->cdev;
+    u64 now = ktime_get_ns();
+    u64 last, period, target;
+    unsigned long flags;
+    s64 span, dt;
+
+    if (guncon2->field_count < 2)
+        return;
+
+    spin_lock_irqsave(&cdev->lock, flags);
+    last = cdev->last_ns;
+    period = cdev->period_ns;
+    spin_unlock_irqrestore(&cdev->lock, flags);
+
+    if (!last || !period || (now > last && now - last > VSYNC_TIMEOUT_NS))
+        return;
+
+    target = last;
+    if (now > last)
+        target += DIV64_U64_ROUND_UP(now - last, period) * period;
+
+    span = guncon2->field_ns[1] - guncon2->field_ns[0];
+    if (span <= 0 || span > VSYNC_MAX_FIELD_NS)
+        return;
+    /*
+     * Samples are only recorded on movement, so a sample older than a field
+     * (plus half a field of slack for report timing) means the gun has
+     * stopped: report where it is, not where the last motion would have
+     * taken it. The lead to the vsync doesn't count towards the age.
+     */
+    if ((s64) (now - guncon2->field_ns[1]) > span + span / 2)
+        return;
+    dt = min_t(s64, (s64) (target - guncon2->field_ns[1]), VSYNC_MAX_EXTRAPOLATE_NS);
+
+    *x = guncon2_extrapolate(guncon2->field_px[0], guncon2->field_px[1], dt, span,
+                             guncon2->range.x_min, guncon2->range.x_max);
+    *y = guncon2_extrapolate(guncon2->field_py[0], guncon2->field_py[1], dt, span,
+                             guncon2->range.y_min, guncon2->range.y_max);
+}
+
+static void guncon2_latency_add(struct guncon2 *guncon2, enum guncon2_path path,
+                                u64 latency_ns)
+{
+    struct guncon2_latency *latency = &guncon2->latency[path];
+
+    WRITE_ONCE(latency->count, latency->count + 1);
+    WRITE_ONCE(latency->total_ns, latency->total_ns + latency_ns);
+    if (latency_ns > latency->max_ns)
+        WRITE_ONCE(latency->max_ns, latency_ns);
+}
+
+/*
+ * Decode one 6-byte report and emit it. Called from the completion handler,
+ * or from the processing thread in threaded mode, never from both at once.
+ */
+static void guncon2_process(struct guncon2 *guncon2, const unsigned char *data,
+                            u64 start_ns, enum guncon2_path path)
 {
-    struct guncon2 *guncon2 = urb->context;
     struct input_dev *js  = guncon2->js_input;
     struct input_dev *mou = guncon2->mouse_input;
-    unsigned char *data   = urb->transfer_buffer;
 
-    int error, buttons;
+    int buttons;
     unsigned short raw_x, raw_y;
     signed char hat_x = 0;
     signed char hat_y = 0;
-    bool invalid_coords = false;
+    enum guncon2_sample kind;
+    bool invalid_coords;
     bool offscreen = false;
-    static int offscreen_frames = 0;
+    bool emit;
+    u16 pos_x, pos_y;
+
+    /* Aiming: 2 bytes buttons, 2 bytes X, 1 byte Y, 1 byte extra */
+    raw_x = (data[3] << 8) | data[2];
+    raw_y = data[4];
+
+    /*
+     * Filter special "no light / unexpected light" codes from the GunCon
+     * protocol and anything outside the calibrated range.
+     *
+     *  - X=0x0001, Y=0x0005  -> unexpected light
+     *  - X=0x0001, Y=0x000A  -> no light / busy
+     *  - X=0x0000, Y=0x0000  -> some clones use this as "idle"
+     */
+    if (raw_x == 1 && raw_y == 5)
+        kind = GUNCON2_SAMPLE_UNEXPECTED_LIGHT;
+    else if ((raw_x == 1 && raw_y == 10) || (raw_x == 0 && raw_y == 0))
+        kind = GUNCON2_SAMPLE_NO_LIGHT;
+    else {
+        /* requested from sysfs, done here so it can't race the learning */
+        if (READ_ONCE(guncon2->autorange_reset)) {
+            WRITE_ONCE(guncon2->autorange_reset, false);
+            guncon2_autorange_reset(guncon2);
+        }
+        if (READ_ONCE(guncon2->autorange))
+            guncon2_autorange(guncon2, raw_x, raw_y);
+        if (raw_x < guncon2->range.x_min || raw_x > guncon2->range.x_max ||
+            raw_y < guncon2->range.y_min || raw_y > guncon2->range.y_max)
+            kind = GUNCON2_SAMPLE_OUT_OF_RANGE;
+        else
+            kind = GUNCON2_SAMPLE_VALID;
+    }
+    invalid_coords = kind != GUNCON2_SAMPLE_VALID;
+
+    if (invalid_coords) {
+        guncon2->offscreen_frames++;
+        /*dev_info(&guncon2->intf->dev,
+                 "guncon2: INVALID coords raw_x=%u raw_y=%u "
+                 "(X_MIN=%d X_MAX=%d Y_MIN=%d Y_MAX=%d)\n",
+                 raw_x, raw_y, X_MIN, X_MAX, Y_MIN, Y_MAX);*/
+    } else {
+        guncon2->offscreen_frames = 0;
+        /*dev_info(&guncon2->intf->dev,
+                 "guncon2: VALID   coords raw_x=%u raw_y=%u\n",
+                 raw_x, raw_y);*/
+    }
+
+    if (guncon2->offscreen_frames >= OFFSCREEN_HYST_FRAMES) {
+        offscreen = true;
+    } else {
+        offscreen = false;
+    }
+    /*dev_info(&guncon2->intf->dev,
+                 "guncon2: OFFSCREEN: %s\n",
+                 offscreen ? "true" : "false");*/
+
+    if (!invalid_coords) {
+        guncon2->last_x = raw_x;
+        guncon2->last_y = raw_y;
+        guncon2->have_last_pos = true;
+        guncon2_field_sample(guncon2, raw_x, raw_y, start_ns);
+    }
+    guncon2_heatmap_add(guncon2, kind);
+
+    /* Buttons */
+    buttons = ((data[0] << 8) | data[1]) ^ 0xffff;
+
+    guncon2_capture(guncon2, raw_x, raw_y, !invalid_coords,
+                    (buttons & ~guncon2->last_buttons) & GUNCON2_TRIGGER,
+                    start_ns);
+    emit = guncon2_decimate(guncon2, raw_x, raw_y, !invalid_coords,
+                            buttons, offscreen);
+    guncon2->last_buttons = buttons;
+    guncon2->last_offscreen = offscreen;
+
+    if (!emit)
+        return;
+
+    /* Always report last good known position */
+    if (guncon2->have_last_pos) {
+        pos_x = guncon2->last_x;
+        pos_y = guncon2->last_y;
+        if (!offscreen)
+            guncon2_resample(guncon2, &pos_x, &pos_y);
+
+        if (js) {
+            input_report_abs(js, ABS_X, pos_x);
+            input_report_abs(js, ABS_Y, pos_y);
+        }
+        if (mou) {
+            input_report_abs(mou, ABS_X, pos_x);
+            input_report_abs(mou, ABS_Y, pos_y);
+        }
+    }
+
+    // d-pad
+    if (buttons & GUNCON2_DPAD_LEFT) {// left
+        hat_x -= 1;
+    }
+    if (buttons & GUNCON2_DPAD_RIGHT) {// right
+        hat_x += 1;
+    }
+    if (buttons & GUNCON2_DPAD_UP) {// up
+        hat_y -= 1;
+    }
+    if (buttons & GUNCON2_DPAD_DOWN) {// down
+        hat_y += 1;
+    }
+
+    if (js) {
+        input_report_abs(js, ABS_HAT0X, hat_x);
+        input_report_abs(js, ABS_HAT0Y, hat_y);
+    }
+
+    /*
+     * Joystick-style buttons
+     *  - trigger as BTN_TRIGGER
+     *  - A/B/C/START/SELECT as joystick/gamepad buttons
+     *  - offscreen as BTN_Z
+     */
+    if (js) {
+        input_report_key(js, BTN_TRIGGER, buttons & GUNCON2_TRIGGER);
+        input_report_key(js, BTN_A, buttons & GUNCON2_BTN_A);
+        input_report_key(js, BTN_B, buttons & GUNCON2_BTN_B);
+        input_report_key(js, BTN_C, buttons & GUNCON2_BTN_C);
+        input_report_key(js, BTN_START, buttons & GUNCON2_BTN_START);
+        input_report_key(js, BTN_SELECT, buttons & GUNCON2_BTN_SELECT);
+        input_report_key(js, BTN_Z, offscreen);
+    }
+
+    /*
+     * Mouse-style buttons – separate input device
+     *  - trigger as BTN_LEFT
+     *  - A/C as BTN_RIGHT
+     *  - B as BTN_MIDDLE
+     *  - offscreen as BTN_EXTRA
+     */
+    if (mou) {
+        input_report_key(mou, BTN_LEFT, buttons & GUNCON2_TRIGGER);
+        input_report_key(mou, BTN_RIGHT, (buttons & GUNCON2_BTN_A) || (buttons & GUNCON2_BTN_C));
+        input_report_key(mou, BTN_MIDDLE, buttons & GUNCON2_BTN_B);
+        input_report_key(mou, BTN_EXTRA, offscreen);
+    }
+
+    if (js)
+        input_sync(js);
+    if (mou)
+        input_sync(mou);
+
+    guncon2_latency_add(guncon2, path, ktime_get_ns() - start_ns);
+}
+
+static int guncon2_thread(void *context)
+{
+    struct guncon2 *guncon2 = context;
+    struct guncon2_report report;
+
+    sched_set_fifo(current);
+
+    while (!kthread_should_stop()) {
+        wait_event_interruptible(guncon2->thread_wait,
+                                 !kfifo_is_empty(&guncon2->reports) ||
+                                 kthread_should_stop());
+
+        /*
+         * Single producer and consumer, the fifo needs no lock. A report
+         * leaves the fifo only once processed, so an empty fifo means the
+         * thread is idle.
+         */
+        while (kfifo_peek(&guncon2->reports, &report)) {
+            guncon2_process(guncon2, report.data, report.timestamp_ns,
+                            GUNCON2_PATH_THREADED);
+            kfifo_skip(&guncon2->reports);
+        }
+        wake_up(&guncon2->drain_wait);
+    }
+
+    return 0;
+}
+
+static void guncon2_usb_irq(struct urb *urb)
+{
+    struct guncon2 *guncon2 = urb->context;
+    unsigned char *data = urb->transfer_buffer;
+    u64 start_ns = ktime_get_ns();
+    struct guncon2_report report;
+    int error;
 
     switch (urb->status) {
         case 0:
@@ -102,123 +824,17 @@ static void guncon2_usb_irq(struct urb *urb)
             goto exit;
     }
 
-    if (urb->actual_length == 6) {
-        /* Aiming: 2 bytes buttons, 2 bytes X, 1 byte Y, 1 byte extra */
-        raw_x = (data[3] << 8) | data[2];
-        raw_y = data[4];
-
-        /*
-         * Filter special "no light / unexpected light" codes from the GunCon
-         * protocol and anything outside the calibrated range.
-         *
-         *  - X=0x0001, Y=0x0005  -> unexpected light
-         *  - X=0x0001, Y=0x000A  -> no light / busy
-         *  - X=0x0000, Y=0x0000  -> some clones use this as "idle"
-         */
-        if (raw_x == 1 && (raw_y == 5 || raw_y == 10))
-            invalid_coords = true;
-        else if (raw_x == 0 && raw_y == 0)
-            invalid_coords = true;
-        else if (raw_x < X_MIN || raw_x > X_MAX ||
-                 raw_y < Y_MIN || raw_y > Y_MAX)
-            invalid_coords = true;
-
-        if (invalid_coords) {
-            offscreen_frames++;
-            /*dev_info(&guncon2->intf->dev,
-                     "guncon2: INVALID coords raw_x=%u raw_y=%u "
-                     "(X_MIN=%d X_MAX=%d Y_MIN=%d Y_MAX=%d)\n",
-                     raw_x, raw_y, X_MIN, X_MAX, Y_MIN, Y_MAX);*/
-        } else {
-            offscreen_frames = 0;
-            /*dev_info(&guncon2->intf->dev,
-                     "guncon2: VALID   coords raw_x=%u raw_y=%u\n",
-                     raw_x, raw_y);*/
-        }
-
-        if (offscreen_frames >= OFFSCREEN_HYST_FRAMES) {
-            offscreen = true;
+    if (urb->actual_length == GUNCON2_REPORT_SIZE) {
+        if (READ_ONCE(guncon2->threaded)) {
+            /* hand off to the processing thread, see guncon2_thread() */
+            report.timestamp_ns = start_ns;
+            memcpy(report.data, data, GUNCON2_REPORT_SIZE);
+            if (!kfifo_put(&guncon2->reports, report))
+                guncon2->reports_dropped++;
+            wake_up(&guncon2->thread_wait);
         } else {
-            offscreen = false;
+            guncon2_process(guncon2, data, start_ns, GUNCON2_PATH_INLINE);
         }
-        /*dev_info(&guncon2->intf->dev,
-                     "guncon2: OFFSCREEN: %s\n",
-                     offscreen ? "true" : "false");*/
-
-        if (!invalid_coords) {
-            guncon2->last_x = raw_x;
-            guncon2->last_y = raw_y;
-            guncon2->have_last_pos = true;
-        }
-
-        /* Always report last good known position */
-        if (guncon2->have_last_pos) {
-            if (js) {
-                input_report_abs(js, ABS_X, guncon2->last_x);
-                input_report_abs(js, ABS_Y, guncon2->last_y);
-            }
-            if (mou) {
-                input_report_abs(mou, ABS_X, guncon2->last_x);
-                input_report_abs(mou, ABS_Y, guncon2->last_y);
-            }
-        }
-
-        /* Buttons */
-        buttons = ((data[0] << 8) | data[1]) ^ 0xffff;
-
-        // d-pad
-        if (buttons & GUNCON2_DPAD_LEFT) {// left
-            hat_x -= 1;
-        }
-        if (buttons & GUNCON2_DPAD_RIGHT) {// right
-            hat_x += 1;
-        }
-        if (buttons & GUNCON2_DPAD_UP) {// up
-            hat_y -= 1;
-        }
-        if (buttons & GUNCON2_DPAD_DOWN) {// down
-            hat_y += 1;
-        }
-
-        if (js) {
-            input_report_abs(js, ABS_HAT0X, hat_x);
-            input_report_abs(js, ABS_HAT0Y, hat_y);
-        }
-
-        /*
-         * Joystick-style buttons
-         *  - trigger as BTN_TRIGGER
-         *  - A/B/C/START/SELECT as joystick/gamepad buttons
-         *  - offscreen as BTN_Z
-         */
-        if (js) {
-            input_report_key(js, BTN_TRIGGER, buttons & GUNCON2_TRIGGER);
-            input_report_key(js, BTN_A, buttons & GUNCON2_BTN_A);
-            input_report_key(js, BTN_B, buttons & GUNCON2_BTN_B);
-            input_report_key(js, BTN_C, buttons & GUNCON2_BTN_C);
-            input_report_key(js, BTN_START, buttons & GUNCON2_BTN_START);
-            input_report_key(js, BTN_SELECT, buttons & GUNCON2_BTN_SELECT);
-            input_report_key(js, BTN_Z, offscreen);
-        }
-
-        /*
-         * Mouse-style buttons – separate input device
-         *  - trigger as BTN_LEFT
-         *  - A/C as BTN_RIGHT
-         *  - B as BTN_MIDDLE
-         *  - offscreen as BTN_EXTRA
-         */
-        if (mou) {
-            input_report_key(mou, BTN_LEFT, buttons & GUNCON2_TRIGGER);
-            input_report_key(mou, BTN_RIGHT, (buttons & GUNCON2_BTN_A) || (buttons & GUNCON2_BTN_C));
-            input_report_key(mou, BTN_MIDDLE, buttons & GUNCON2_BTN_B);
-            input_report_key(mou, BTN_EXTRA, offscreen);
-        }
-
-        if (js)
-            input_sync(js);
-        if (mou)
-            input_sync(mou);
     }
 
 exit:
@@ -288,17 +904,295 @@ static void guncon2_close(struct input_dev *input)
     mutex_unlock(&guncon2->pm_mutex);
 }
 
+static void guncon2_stop_thread(void *context) {
+    struct guncon2 *guncon2 = context;
+
+    kthread_stop(guncon2->thread);
+}
+
 static void guncon2_free_urb(void *context) {
     struct guncon2 *guncon2 = context;
 
     usb_free_urb(guncon2->urb);
 }
 
+static void guncon2_cdev_free(struct kref *kref)
+{
+    kfree(container_of(kref, struct guncon2_cdev, kref));
+}
+
+static int guncon2_cdev_open(struct inode *inode, struct file *file)
+{
+    struct guncon2_cdev *cdev =
+            container_of(file->private_data, struct guncon2_cdev, misc);
+
+    kref_get(&cdev->kref);
+    file->private_data = cdev;
+    return nonseekable_open(inode, file);
+}
+
+static int guncon2_cdev_release(struct inode *inode, struct file *file)
+{
+    struct guncon2_cdev *cdev = file->private_data;
+
+    kref_put(&cdev->kref, guncon2_cdev_free);
+    return 0;
+}
+
+static void guncon2_vsync_feed(struct guncon2_cdev *cdev, u64 timestamp)
+{
+    unsigned long flags;
+    u64 delta;
+
+    spin_lock_irqsave(&cdev->lock, flags);
+    if (cdev->last_ns && timestamp > cdev->last_ns) {
+        delta = timestamp - cdev->last_ns;
+        /* moving average over ~8 frames, a gap restarts it */
+        if (delta > VSYNC_MAX_PERIOD_NS)
+            cdev->period_ns = 0;
+        else if (!cdev->period_ns)
+            cdev->period_ns = delta;
+        else
+            cdev->period_ns += div64_s64((s64) delta - (s64) cdev->period_ns, 8);
+    }
+    if (timestamp > cdev->last_ns)
+        cdev->last_ns = timestamp;
+    spin_unlock_irqrestore(&cdev->lock, flags);
+}
+
+/* Pops whole struct guncon2_shot records, oldest first */
+static ssize_t guncon2_cdev_read(struct file *file, char __user *buf,
+                                 size_t count, loff_t *ppos)
+{
+    struct guncon2_cdev *cdev = file->private_data;
+    struct guncon2_shot shot;
+    size_t read = 0;
+    int error;
+
+    if (count < sizeof(shot))
+        return -EINVAL;
+
+    for (;;) {
+        while (read + sizeof(shot) <= count &&
+               kfifo_out_spinlocked(&cdev->shots, &shot, 1, &cdev->shots_lock)) {
+            if (copy_to_user(buf + read, &shot, sizeof(shot)))
+                return -EFAULT;
+            read += sizeof(shot);
+        }
+        if (read)
+            return read;
+        if (READ_ONCE(cdev->disconnected))
+            return -ENODEV;
+        if (file->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+
+        error = wait_event_interruptible(cdev->shots_wait,
+                                         !kfifo_is_empty(&cdev->shots) ||
+                                         READ_ONCE(cdev->disconnected));
+        if (error)
+            return error;
+    }
+}
+
+static __poll_t guncon2_cdev_poll(struct file *file, poll_table *wait)
+{
+    struct guncon2_cdev *cdev = file->private_data;
+    __poll_t mask = 0;
+
+    poll_wait(file, &cdev->shots_wait, wait);
+    if (!kfifo_is_empty(&cdev->shots))
+        mask |= EPOLLIN | EPOLLRDNORM;
+    if (READ_ONCE(cdev->disconnected))
+        mask |= EPOLLHUP | EPOLLERR;
+    return mask;
+}
+
+static long guncon2_cdev_ioctl(struct file *file, unsigned int cmd,
+                               unsigned long arg)
+{
+    struct guncon2_cdev *cdev = file->private_data;
+    struct guncon2_vsync ts;
+    unsigned long flags;
+
+    switch (cmd) {
+        case GUNCON2_IOC_VSYNC:
+            if (copy_from_user(&ts, (void __user *) arg, sizeof(ts)))
+                return -EFAULT;
+            guncon2_vsync_feed(cdev, ts.timestamp_ns);
+            return 0;
+        case GUNCON2_IOC_VSYNC_OFF:
+            spin_lock_irqsave(&cdev->lock, flags);
+            cdev->last_ns = 0;
+            cdev->period_ns = 0;
+            spin_unlock_irqrestore(&cdev->lock, flags);
+            return 0;
+        default:
+            return -ENOTTY;
+    }
+}
+
+static const struct file_operations guncon2_cdev_fops = {
+        .owner = THIS_MODULE,
+        .open = guncon2_cdev_open,
+        .release = guncon2_cdev_release,
+        .read = guncon2_cdev_read,
+        .poll = guncon2_cdev_poll,
+        .unlocked_ioctl = guncon2_cdev_ioctl,
+        .compat_ioctl = compat_ptr_ioctl,
+};
+
+static void guncon2_cdev_destroy(void *context) {
+    struct guncon2_cdev *cdev = context;
+
+    WRITE_ONCE(cdev->disconnected, true);
+    wake_up_interruptible(&cdev->shots_wait);
+    misc_deregister(&cdev->misc);
+    ida_free(&guncon2_ida, cdev->id);
+    kref_put(&cdev->kref, guncon2_cdev_free);
+}
+
+static int guncon2_cdev_create(struct guncon2 *guncon2)
+{
+    struct guncon2_cdev *cdev;
+    int error;
+
+    cdev = kzalloc(sizeof(*cdev), GFP_KERNEL);
+    if (!cdev)
+        return -ENOMEM;
+
+    kref_init(&cdev->kref);
+    spin_lock_init(&cdev->lock);
+    spin_lock_init(&cdev->shots_lock);
+    init_waitqueue_head(&cdev->shots_wait);
+    INIT_KFIFO(cdev->shots);
+
+    cdev->id = ida_alloc(&guncon2_ida, GFP_KERNEL);
+    if (cdev->id < 0) {
+        error = cdev->id;
+        kfree(cdev);
+        return error;
+    }
+
+    snprintf(cdev->name, sizeof(cdev->name), "guncon2-%d", cdev->id);
+    cdev->misc.minor = MISC_DYNAMIC_MINOR;
+    cdev->misc.name = cdev->name;
+    cdev->misc.fops = &guncon2_cdev_fops;
+    cdev->misc.parent = &guncon2->intf->dev;
+
+    error = misc_register(&cdev->misc);
+    if (error) {
+        ida_free(&guncon2_ida, cdev->id);
+        kfree(cdev);
+        return error;
+    }
+
+    guncon2->cdev = cdev;
+    return devm_add_action_or_reset(&guncon2->intf->dev, guncon2_cdev_destroy, cdev);
+}
+
+static int guncon2_heatmap_show(struct seq_file *m, void *v)
+{
+    struct guncon2 *guncon2 = m->private;
+    unsigned int kind, row, col;
+
+    seq_printf(m, "# %ux%u cells of %ux%u raw units\n",
+               HEATMAP_COLS, HEATMAP_ROWS,
+               HEATMAP_X_SPAN / HEATMAP_COLS, HEATMAP_Y_SPAN / HEATMAP_ROWS);
+
+    for (kind = 0; kind < GUNCON2_SAMPLE_KINDS; kind++) {
+        seq_printf(m, "\n%s\n", guncon2_sample_names[kind]);
+        for (row = 0; row < HEATMAP_ROWS; row++) {
+            for (col = 0; col < HEATMAP_COLS; col++)
+                seq_printf(m, "%s%u", col ? " " : "",
+                           READ_ONCE(guncon2->heatmap[kind][row][col]));
+            seq_putc(m, '\n');
+        }
+    }
+
+    return 0;
+}
+
+static int guncon2_heatmap_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, guncon2_heatmap_show, inode->i_private);
+}
+
+/* any write clears the heatmap */
+static ssize_t guncon2_heatmap_write(struct file *file, const char __user *buf,
+                                     size_t count, loff_t *ppos)
+{
+    struct guncon2 *guncon2 = ((struct seq_file *) file->private_data)->private;
+
+    memset(guncon2->heatmap, 0, sizeof(guncon2->heatmap));
+    return count;
+}
+
+static const struct file_operations guncon2_heatmap_fops = {
+        .owner = THIS_MODULE,
+        .open = guncon2_heatmap_open,
+        .read = seq_read,
+        .write = guncon2_heatmap_write,
+        .llseek = seq_lseek,
+        .release = single_release,
+};
+
+/* Per path "<path> <count> <avg_ns> <max_ns>", then the dropped reports */
+static int guncon2_latency_show(struct seq_file *m, void *v)
+{
+    struct guncon2 *guncon2 = m->private;
+    struct guncon2_latency *latency;
+    u64 count;
+    int path;
+
+    for (path = 0; path < GUNCON2_PATHS; path++) {
+        latency = &guncon2->latency[path];
+        count = READ_ONCE(latency->count);
+        seq_printf(m, "%s %llu %llu %llu\n", guncon2_path_names[path], count,
+                   count ? div64_u64(READ_ONCE(latency->total_ns), count) : 0,
+                   READ_ONCE(latency->max_ns));
+    }
+    seq_printf(m, "dropped %lu\n", READ_ONCE(guncon2->reports_dropped));
+
+    return 0;
+}
+
+static int guncon2_latency_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, guncon2_latency_show, inode->i_private);
+}
+
+/* any write resets the counters */
+static ssize_t guncon2_latency_write(struct file *file, const char __user *buf,
+                                     size_t count, loff_t *ppos)
+{
+    struct guncon2 *guncon2 = ((struct seq_file *) file->private_data)->private;
+
+    memset(guncon2->latency, 0, sizeof(guncon2->latency));
+    WRITE_ONCE(guncon2->reports_dropped, 0);
+    return count;
+}
+
+static const struct file_operations guncon2_latency_fops = {
+        .owner = THIS_MODULE,
+        .open = guncon2_latency_open,
+        .read = seq_read,
+        .write = guncon2_latency_write,
+        .llseek = seq_lseek,
+        .release = single_release,
+};
+
+static void guncon2_remove_debugfs(void *context) {
+    struct dentry *dir = context;
+
+    debugfs_remove_recursive(dir);
+}
+
 static int guncon2_probe(struct usb_interface *intf,
                          const struct usb_device_id *id) {
     struct usb_device *udev = interface_to_usbdev(intf);
     struct guncon2 *guncon2;
     struct usb_endpoint_descriptor *epirq;
+    struct dentry *dir;
     size_t xfer_size;
     void *xfer_buf;
     int error;
@@ -320,6 +1214,10 @@ static int guncon2_probe(struct usb_interface *intf,
         return -ENOMEM;
 
     mutex_init(&guncon2->pm_mutex);
+    guncon2_autorange_reset(guncon2);
+    init_waitqueue_head(&guncon2->thread_wait);
+    init_waitqueue_head(&guncon2->drain_wait);
+    INIT_KFIFO(guncon2->reports);
     guncon2->intf = intf;
 
     usb_set_intfdata(guncon2->intf, guncon2);
@@ -342,6 +1240,18 @@ static int guncon2_probe(struct usb_interface *intf,
                      usb_rcvintpipe(udev, epirq->bEndpointAddress),
                      xfer_buf, xfer_size, guncon2_usb_irq, guncon2, 1);
 
+    /* diagnostics, failures here are not fatal */
+    dir = debugfs_create_dir(dev_name(&intf->dev), guncon2_debugfs_root);
+    debugfs_create_file("heatmap", 0600, dir, guncon2, &guncon2_heatmap_fops);
+    debugfs_create_file("latency", 0600, dir, guncon2, &guncon2_latency_fops);
+    error = devm_add_action_or_reset(&intf->dev, guncon2_remove_debugfs, dir);
+    if (error)
+        return error;
+
+    error = guncon2_cdev_create(guncon2);
+    if (error)
+        return error;
+
     /* get path tree for the usb device */
     usb_make_path(udev, guncon2->phys, sizeof(guncon2->phys));
     strlcat(guncon2->phys, "/input0", sizeof(guncon2->phys));
@@ -427,6 +1337,20 @@ static int guncon2_probe(struct usb_interface *intf,
     if (error)
         return error;
 
+    /*
+     * Created last so that it is stopped before the input devices go away.
+     * Threaded mode can't be selected before probe returns, so nothing is
+     * queued for it until then.
+     */
+    guncon2->thread = kthread_run(guncon2_thread, guncon2, "guncon2/%s",
+                                  dev_name(&intf->dev));
+    if (IS_ERR(guncon2->thread))
+        return PTR_ERR(guncon2->thread);
+
+    error = devm_add_action_or_reset(&intf->dev, guncon2_stop_thread, guncon2);
+    if (error)
+        return error;
+
     return 0;
 }
 
@@ -484,6 +1408,182 @@ static int guncon2_reset_resume(struct usb_interface *intf) {
     return guncon2_resume(intf);
 }
 
+static ssize_t calib_capture_show(struct device *dev,
+                                  struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(guncon2->capture_enabled));
+}
+
+static ssize_t calib_capture_store(struct device *dev,
+                                   struct device_attribute *attr,
+                                   const char *buf, size_t count)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+    unsigned long flags;
+    bool enable;
+    int error;
+
+    error = kstrtobool(buf, &enable);
+    if (error)
+        return error;
+
+    /* start every session with an empty queue */
+    spin_lock_irqsave(&guncon2->cdev->shots_lock, flags);
+    kfifo_reset(&guncon2->cdev->shots);
+    WRITE_ONCE(guncon2->capture_enabled, enable);
+    spin_unlock_irqrestore(&guncon2->cdev->shots_lock, flags);
+
+    return count;
+}
+static DEVICE_ATTR_RW(calib_capture);
+
+static ssize_t autorange_show(struct device *dev,
+                              struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(guncon2->autorange));
+}
+
+static ssize_t autorange_store(struct device *dev,
+                               struct device_attribute *attr,
+                               const char *buf, size_t count)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+    bool enable;
+    int error;
+
+    error = kstrtobool(buf, &enable);
+    if (error)
+        return error;
+
+    /* restart learning from the default calibration with the next report */
+    WRITE_ONCE(guncon2->autorange_reset, true);
+    WRITE_ONCE(guncon2->autorange, enable);
+
+    return count;
+}
+static DEVICE_ATTR_RW(autorange);
+
+/* Learned quantiles: "x_lo x_hi y_lo y_hi" */
+static ssize_t autorange_quantiles_show(struct device *dev,
+                                        struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+
+    return sysfs_emit(buf, "%u %u %u %u\n",
+                      READ_ONCE(guncon2->quantile_x_lo) >> AUTORANGE_FRAC_BITS,
+                      READ_ONCE(guncon2->quantile_x_hi) >> AUTORANGE_FRAC_BITS,
+                      READ_ONCE(guncon2->quantile_y_lo) >> AUTORANGE_FRAC_BITS,
+                      READ_ONCE(guncon2->quantile_y_hi) >> AUTORANGE_FRAC_BITS);
+}
+static DEVICE_ATTR_RO(autorange_quantiles);
+
+/* Accepted raw window: "x_min x_max y_min y_max" */
+static ssize_t range_show(struct device *dev,
+                          struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+
+    return sysfs_emit(buf, "%u %u %u %u\n",
+                      READ_ONCE(guncon2->range.x_min), READ_ONCE(guncon2->range.x_max),
+                      READ_ONCE(guncon2->range.y_min), READ_ONCE(guncon2->range.y_max));
+}
+static DEVICE_ATTR_RO(range);
+
+static ssize_t decimate_show(struct device *dev,
+                             struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+    int mode = READ_ONCE(guncon2->decimate);
+
+    if (mode == DECIMATE_OFF)
+        return sysfs_emit(buf, "off\n");
+    if (mode == DECIMATE_CHANGE)
+        return sysfs_emit(buf, "change\n");
+    return sysfs_emit(buf, "%d\n", mode);
+}
+
+/* "off", "change" or a maximum output rate in Hz */
+static ssize_t decimate_store(struct device *dev,
+                              struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+    unsigned int rate;
+    int mode;
+    int error;
+
+    if (sysfs_streq(buf, "off")) {
+        mode = DECIMATE_OFF;
+    } else if (sysfs_streq(buf, "change")) {
+        mode = DECIMATE_CHANGE;
+    } else {
+        error = kstrtouint(buf, 10, &rate);
+        if (error)
+            return error;
+        if (rate > DECIMATE_MAX_HZ)
+            return -EINVAL;
+        mode = rate;
+    }
+
+    WRITE_ONCE(guncon2->decimate, mode);
+    return count;
+}
+static DEVICE_ATTR_RW(decimate);
+
+static ssize_t threaded_show(struct device *dev,
+                             struct device_attribute *attr, char *buf)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+
+    return sysfs_emit(buf, "%d\n", READ_ONCE(guncon2->threaded));
+}
+
+/* The processing path can only change while no one has the device open */
+static ssize_t threaded_store(struct device *dev,
+                              struct device_attribute *attr,
+                              const char *buf, size_t count)
+{
+    struct guncon2 *guncon2 = usb_get_intfdata(to_usb_interface(dev));
+    bool enable;
+    int error;
+
+    error = kstrtobool(buf, &enable);
+    if (error)
+        return error;
+
+    mutex_lock(&guncon2->pm_mutex);
+    if (guncon2->open_count) {
+        mutex_unlock(&guncon2->pm_mutex);
+        return -EBUSY;
+    }
+    /*
+     * The urb is killed while closed, but the thread may still be working
+     * through what was queued before; let it finish so the two paths never
+     * process reports at the same time.
+     */
+    wait_event(guncon2->drain_wait, kfifo_is_empty(&guncon2->reports));
+    WRITE_ONCE(guncon2->threaded, enable);
+    mutex_unlock(&guncon2->pm_mutex);
+
+    return count;
+}
+static DEVICE_ATTR_RW(threaded);
+
+static struct attribute *guncon2_attrs[] = {
+        &dev_attr_calib_capture.attr,
+        &dev_attr_autorange.attr,
+        &dev_attr_autorange_quantiles.attr,
+        &dev_attr_range.attr,
+        &dev_attr_decimate.attr,
+        &dev_attr_threaded.attr,
+        NULL,
+};
+ATTRIBUTE_GROUPS(guncon2);
+
 static const struct usb_device_id guncon2_table[] = {
         {USB_DEVICE(NAMCO_VENDOR_ID, GUNCON2_PRODUCT_ID)},
         {}};
@@ -500,9 +1600,30 @@ static struct usb_driver guncon2_driver = {
         .pre_reset = guncon2_pre_reset,
         .post_reset = guncon2_post_reset,
         .reset_resume = guncon2_reset_resume,
+        .dev_groups = guncon2_groups,
 };
 
-module_usb_driver(guncon2_driver);
+static int __init guncon2_init(void)
+{
+    int error;
+
+    guncon2_debugfs_root = debugfs_create_dir("guncon2", NULL);
+
+    error = usb_register(&guncon2_driver);
+    if (error)
+        debugfs_remove_recursive(guncon2_debugfs_root);
+
+    return error;
+}
+
+static void __exit guncon2_exit(void)
+{
+    usb_deregister(&guncon2_driver);
+    debugfs_remove_recursive(guncon2_debugfs_root);
+}
+
+module_init(guncon2_init);
+module_exit(guncon2_exit);
 
 MODULE_AUTHOR("rtomas <ruben.tomas.alonso@gmail.com>");
 MODULE_DESCRIPTION("Namco GunCon 2");
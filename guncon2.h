@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Userspace interface of the Namco GunCon 2 driver
+ *
+ * Each gun gets a /dev/guncon2-N character device. Consumers that render on
+ * their own vsync feed its timestamps with GUNCON2_IOC_VSYNC; while they keep
+ * coming the driver reports the position extrapolated to the predicted next
+ * vsync, so the aim has the same age on every frame.
+ *
+ * While the calib_capture attribute is set, read() returns one struct
+ * guncon2_shot per trigger press, oldest first; it blocks (or fails with
+ * EAGAIN under O_NONBLOCK) while none is queued, and poll() reports when one
+ * is.
+ */
+#ifndef _GUNCON2_H
+#define _GUNCON2_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+struct guncon2_vsync {
+    __u64 timestamp_ns; /* CLOCK_MONOTONIC */
+};
+
+/* Positions in raw units, fixed point with GUNCON2_SHOT_FRAC_BITS */
+#define GUNCON2_SHOT_FRAC_BITS 4
+
+struct guncon2_shot {
+    __u64 timestamp_ns; /* CLOCK_MONOTONIC of the report with the trigger edge */
+    __u32 seq;          /* counts trigger presses */
+    __u32 x;            /* median */
+    __u32 y;
+    __u32 spread_x;     /* median absolute deviation */
+    __u32 spread_y;
+    __u32 samples;      /* 0 when the gun saw no light */
+};
+
+#define GUNCON2_IOC_MAGIC 'G'
+
+/* Feed one vsync timestamp */
+#define GUNCON2_IOC_VSYNC _IOW(GUNCON2_IOC_MAGIC, 0x01, struct guncon2_vsync)
+/* Stop resampling until the next GUNCON2_IOC_VSYNC */
+#define GUNCON2_IOC_VSYNC_OFF _IO(GUNCON2_IOC_MAGIC, 0x02)
+
+#endif /* _GUNCON2_H */
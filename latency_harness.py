@@ -0,0 +1,587 @@
+#!/usr/bin/env python3
+"""
+Report-to-evdev latency harness for the GunCon 2 driver.
+
+A virtual GunCon 2 is created with a configfs HID gadget on dummy_hcd, so the
+real driver binds to it without any hardware. Reports written to the gadget
+are timestamped and matched with the evdev events the driver produces, while
+optional background CPU load, USB load and periodic port resets run, so
+PREEMPT_RT and non-RT kernels can be compared under the same conditions.
+With --userspace the virtual gun is driven by userspace/guncon2d instead.
+
+Needs root and the dummy_hcd, libcomposite and usb_f_hid modules.
+"""
+import argparse
+import ctypes
+import fcntl
+import glob
+import json
+import multiprocessing
+import os
+import platform
+import select
+import signal
+import struct
+import subprocess
+import sys
+import threading
+import time
+
+import logging
+
+log = logging.getLogger("guncon2-latency")
+
+NAMCO_VENDOR_ID = 0x0b9a
+GUNCON2_PRODUCT_ID = 0x016a
+
+CONFIGFS = "/sys/kernel/config/usb_gadget"
+DEBUGFS = "/sys/kernel/debug/guncon2"
+# phys of the uinput devices created by userspace/guncon2d
+USERSPACE_PHYS = "guncon2d/input0"
+GADGET_NAME = "guncon2_virtual"
+
+# vendor page, one 6 byte input report, matching the real gun's reports
+REPORT_DESC = bytes([
+    0x06, 0x00, 0xff,  # Usage Page (Vendor Defined)
+    0x09, 0x01,        # Usage (1)
+    0xa1, 0x01,        # Collection (Application)
+    0x15, 0x00,        #   Logical Minimum (0)
+    0x26, 0xff, 0x00,  #   Logical Maximum (255)
+    0x75, 0x08,        #   Report Size (8)
+    0x95, 0x06,        #   Report Count (6)
+    0x09, 0x01,        #   Usage (1)
+    0x81, 0x02,        #   Input (Data, Variable, Absolute)
+    0xc0,              # End Collection
+])
+
+# X cycles through the default calibrated range so every report is a new event
+X_FIRST = 200
+X_LAST = 700
+Y_POS = 120
+# unloaded resets timed to find the nominal reset duration
+BASELINE_RESETS = 3
+
+EV_ABS = 0x03
+ABS_X = 0x00
+INPUT_EVENT = struct.Struct("llHHi")
+CLOCK_MONOTONIC = 1
+
+
+def _ioc(direction, type_, nr, size):
+    return (direction << 30) | (size << 16) | (ord(type_) << 8) | nr
+
+
+EVIOCSCLOCKID = _ioc(1, "E", 0xa0, 4)
+USBDEVFS_RESET = _ioc(0, "U", 20, 0)
+
+
+class UsbCtrlTransfer(ctypes.Structure):
+    _fields_ = [("bRequestType", ctypes.c_uint8),
+                ("bRequest", ctypes.c_uint8),
+                ("wValue", ctypes.c_uint16),
+                ("wIndex", ctypes.c_uint16),
+                ("wLength", ctypes.c_uint16),
+                ("timeout", ctypes.c_uint32),
+                ("data", ctypes.c_void_p)]
+
+
+USBDEVFS_CONTROL = _ioc(3, "U", 0, ctypes.sizeof(UsbCtrlTransfer))
+
+
+def now_ns():
+    return time.clock_gettime_ns(time.CLOCK_MONOTONIC)
+
+
+def write_file(path, value):
+    with open(path, "wb" if isinstance(value, bytes) else "w") as f:
+        f.write(value)
+
+
+def read_file(path):
+    with open(path) as f:
+        return f.read().strip()
+
+
+def percentile(values, pct):
+    if not values:
+        return 0
+    return values[min(len(values) - 1, int(len(values) * pct / 100.0))]
+
+
+def is_preempt_rt():
+    try:
+        if read_file("/sys/kernel/realtime") == "1":
+            return True
+    except OSError:
+        pass
+    return "PREEMPT_RT" in platform.uname().version
+
+
+class VirtualGun(object):
+    """
+    A GunCon 2 lookalike on dummy_hcd, bound to the guncon2 driver, or driven
+    by the userspace reference driver when a guncon2d binary is given.
+    """
+
+    def __init__(self, userspace=None):
+        self.gadget = os.path.join(CONFIGFS, GADGET_NAME)
+        self.hidg = None
+        self.usb_dev = None
+        self.intf = None
+        self.userspace = userspace
+        self.daemon = None
+
+    def __enter__(self):
+        modules = ["dummy_hcd", "libcomposite", "usb_f_hid"]
+        if not self.userspace:
+            modules.append("guncon2")
+        for module in modules:
+            subprocess.run(["modprobe", module], check=True)
+        self._create_gadget()
+        try:
+            self._bind_host()
+        except Exception:
+            self.stop_userspace()
+            self._remove_gadget()
+            raise
+        return self
+
+    def __exit__(self, *exc):
+        self.stop_userspace()
+        self._remove_gadget()
+
+    def _create_gadget(self):
+        g = self.gadget
+        os.makedirs(g)
+        write_file(f"{g}/idVendor", f"0x{NAMCO_VENDOR_ID:04x}")
+        write_file(f"{g}/idProduct", f"0x{GUNCON2_PRODUCT_ID:04x}")
+        write_file(f"{g}/bcdUSB", "0x0200")
+        os.makedirs(f"{g}/strings/0x409")
+        write_file(f"{g}/strings/0x409/manufacturer", "Namco")
+        write_file(f"{g}/strings/0x409/product", "GunCon 2 (virtual)")
+        write_file(f"{g}/strings/0x409/serialnumber", "0")
+        os.makedirs(f"{g}/configs/c.1/strings/0x409")
+        write_file(f"{g}/configs/c.1/strings/0x409/configuration", "guncon2")
+        os.makedirs(f"{g}/functions/hid.usb0")
+        write_file(f"{g}/functions/hid.usb0/protocol", "0")
+        write_file(f"{g}/functions/hid.usb0/subclass", "0")
+        write_file(f"{g}/functions/hid.usb0/report_length", "6")
+        write_file(f"{g}/functions/hid.usb0/report_desc", REPORT_DESC)
+        os.symlink(f"{g}/functions/hid.usb0", f"{g}/configs/c.1/hid.usb0")
+
+        udcs = [udc for udc in os.listdir("/sys/class/udc") if udc.startswith("dummy_udc")]
+        if not udcs:
+            raise RuntimeError("no dummy_udc found, is dummy_hcd loaded?")
+        write_file(f"{g}/UDC", udcs[0])
+
+        major, minor = read_file(f"{g}/functions/hid.usb0/dev").split(":")
+        rdev = os.makedev(int(major), int(minor))
+        for path in glob.glob("/dev/hidg*"):
+            if os.stat(path).st_rdev == rdev:
+                self.hidg = path
+        if self.hidg is None:
+            raise RuntimeError("gadget HID node not found")
+
+    def _remove_gadget(self):
+        g = self.gadget
+        if not os.path.exists(g):
+            return
+        try:
+            write_file(f"{g}/UDC", "\n")
+        except OSError:
+            pass
+        for path in (f"{g}/configs/c.1/hid.usb0",):
+            if os.path.islink(path):
+                os.unlink(path)
+        for path in (f"{g}/functions/hid.usb0", f"{g}/configs/c.1/strings/0x409",
+                     f"{g}/configs/c.1", f"{g}/strings/0x409", g):
+            if os.path.exists(path):
+                os.rmdir(path)
+
+    def _bind_host(self, timeout=5.0):
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            for dev in glob.glob("/sys/bus/usb/devices/*"):
+                try:
+                    if (int(read_file(f"{dev}/idVendor"), 16) == NAMCO_VENDOR_ID and
+                            int(read_file(f"{dev}/idProduct"), 16) == GUNCON2_PRODUCT_ID and
+                            "dummy_hcd" in os.path.realpath(dev)):
+                        self.usb_dev = dev
+                except OSError:
+                    continue
+            if self.usb_dev and os.path.exists(f"{self.usb_dev}:1.0"):
+                break
+            time.sleep(0.1)
+        else:
+            raise RuntimeError("virtual gun did not enumerate")
+
+        self.intf = f"{self.usb_dev}:1.0"
+        name = os.path.basename(self.intf)
+        driver = os.path.join(self.intf, "driver")
+        # the gadget is HID class, so usbhid may have claimed it first
+        host_driver = "" if self.userspace else "guncon2"
+        if os.path.exists(driver) and os.path.basename(os.path.realpath(driver)) != host_driver:
+            write_file(os.path.join(os.path.realpath(driver), "unbind"), name)
+        if self.userspace:
+            self.daemon = subprocess.Popen([self.userspace], stdout=subprocess.PIPE, text=True)
+            log.info(f"Virtual gun {name} driven by {self.userspace}, gadget node {self.hidg}")
+            return
+        if not os.path.exists(driver):
+            write_file("/sys/bus/usb/drivers/guncon2/bind", name)
+        log.info(f"Virtual gun {name} bound to guncon2, gadget node {self.hidg}")
+
+    def stop_userspace(self):
+        """Stop guncon2d and return the statistics it prints on exit."""
+        if self.daemon is None:
+            return ""
+        daemon, self.daemon = self.daemon, None
+        if daemon.poll() is None:
+            daemon.send_signal(signal.SIGINT)
+        try:
+            stats, _ = daemon.communicate(timeout=5)
+        except subprocess.TimeoutExpired:
+            daemon.kill()
+            stats, _ = daemon.communicate()
+        return stats
+
+    @property
+    def usbfs(self):
+        return "/dev/bus/usb/{:03d}/{:03d}".format(int(read_file(f"{self.usb_dev}/busnum")),
+                                                   int(read_file(f"{self.usb_dev}/devnum")))
+
+    def debugfs(self, name):
+        return os.path.join(DEBUGFS, os.path.basename(self.intf), name)
+
+    def event_node(self, suffix):
+        if self.userspace:
+            return self._uinput_node(suffix)
+        for input_dir in glob.glob(f"{self.intf}/input/input*"):
+            if read_file(f"{input_dir}/name").endswith(suffix):
+                return "/dev/input/" + os.path.basename(glob.glob(f"{input_dir}/event*")[0])
+        raise RuntimeError(f"no '{suffix}' input device for the virtual gun")
+
+    def _uinput_node(self, suffix):
+        """guncon2d's uinput devices aren't below the interface, find them by name and phys."""
+        for _ in range(50):
+            for input_dir in glob.glob("/sys/class/input/input*"):
+                try:
+                    if (read_file(f"{input_dir}/phys") == USERSPACE_PHYS and
+                            read_file(f"{input_dir}/name").endswith(suffix)):
+                        return "/dev/input/" + os.path.basename(glob.glob(f"{input_dir}/event*")[0])
+                except (OSError, IndexError):
+                    continue
+            if self.daemon is None or self.daemon.poll() is not None:
+                break
+            time.sleep(0.1)
+        raise RuntimeError(f"no '{suffix}' uinput device from {self.userspace}")
+
+
+def cpu_hog(rt_priority):
+    if rt_priority:
+        os.sched_setscheduler(0, os.SCHED_FIFO, os.sched_param(rt_priority))
+        # leave the CPU now and then, or a FIFO hog locks up the box
+        while True:
+            end = time.monotonic() + 0.05
+            while time.monotonic() < end:
+                pass
+            time.sleep(0.001)
+    while True:
+        pass
+
+
+class Harness(object):
+    def __init__(self, gun, args):
+        self.gun = gun
+        self.args = args
+        self.stop = threading.Event()
+        self.sent = {}
+        self.latencies = []
+        self.lost = 0
+        # (start, end) of every port reset and every probe open(), in ns
+        self.resets = []
+        self.open_waits = []
+        # longest reset allowed before it counts as stretched by inversion, in ns
+        self.reset_limit = None
+        self.reset_nominal = None
+        self.usb_transfers = 0
+        self.lock = threading.Lock()
+
+    def writer(self):
+        period = 1.0 / self.args.rate
+        x = X_FIRST
+        fd = os.open(self.gun.hidg, os.O_WRONLY)
+        try:
+            next_t = time.monotonic()
+            while not self.stop.is_set():
+                report = bytes([0xff, 0xff, x & 0xff, x >> 8, Y_POS, 0])
+                with self.lock:
+                    if x in self.sent:
+                        self.lost += 1
+                    self.sent[x] = now_ns()
+                try:
+                    os.write(fd, report)
+                except OSError:
+                    # the port is being reset, try again on the next tick
+                    with self.lock:
+                        self.sent.pop(x, None)
+                x = X_FIRST if x >= X_LAST else x + 1
+                next_t += period
+                time.sleep(max(0.0, next_t - time.monotonic()))
+        finally:
+            os.close(fd)
+
+    def reader(self, path):
+        fd = os.open(path, os.O_RDONLY | os.O_NONBLOCK)
+        try:
+            fcntl.ioctl(fd, EVIOCSCLOCKID, struct.pack("i", CLOCK_MONOTONIC))
+            while not self.stop.is_set():
+                if not select.select([fd], [], [], 0.1)[0]:
+                    continue
+                try:
+                    data = os.read(fd, INPUT_EVENT.size * 64)
+                except BlockingIOError:
+                    continue
+                for off in range(0, len(data), INPUT_EVENT.size):
+                    sec, usec, type_, code, value = INPUT_EVENT.unpack_from(data, off)
+                    if type_ != EV_ABS or code != ABS_X:
+                        continue
+                    with self.lock:
+                        sent = self.sent.pop(value, None)
+                    if sent is not None:
+                        self.latencies.append(sec * 1000000000 + usec * 1000 - sent)
+        finally:
+            os.close(fd)
+
+    def open_probe(self, path):
+        """High priority opener: guncon2_open()/close() take pm_mutex, as do the reset hooks."""
+        if self.args.probe_priority:
+            os.sched_setscheduler(0, os.SCHED_FIFO, os.sched_param(self.args.probe_priority))
+        while not self.stop.is_set():
+            start = now_ns()
+            fd = os.open(path, os.O_RDONLY)
+            self.open_waits.append((start, now_ns()))
+            os.close(fd)
+            time.sleep(0.01)
+
+    def reset(self):
+        """Reset the virtual gun's port, returns the (start, end) of the reset."""
+        fd = os.open(self.gun.usbfs, os.O_WRONLY)
+        start = now_ns()
+        try:
+            fcntl.ioctl(fd, USBDEVFS_RESET)
+        except OSError as err:
+            log.warning(f"USB reset failed: {err}")
+        finally:
+            end = now_ns()
+            os.close(fd)
+        return start, end
+
+    def calibrate_resets(self):
+        """
+        Time a few resets before any load starts. Under load, a reset that
+        takes longer than this plus --stall-us was stretched while it held
+        pm_mutex, which is the inversion the probe is there to catch.
+        """
+        if self.args.reset_us is not None:
+            self.reset_limit = self.args.reset_us * 1000
+            return
+        durations = []
+        for _ in range(BASELINE_RESETS):
+            start, end = self.reset()
+            durations.append(end - start)
+            time.sleep(0.5)
+        self.reset_nominal = max(durations)
+        self.reset_limit = self.reset_nominal + self.args.stall_us * 1000
+        log.info(f"Nominal reset {self.reset_nominal / 1000.0:.1f}us, "
+                 f"limit {self.reset_limit / 1000.0:.1f}us")
+
+    def resetter(self):
+        while not self.stop.wait(self.args.reset_interval):
+            self.resets.append(self.reset())
+
+    def usb_load(self):
+        """Keep the host controller busy with GET_DESCRIPTOR(device) control transfers."""
+        buf = ctypes.create_string_buffer(18)
+        ctrl = UsbCtrlTransfer(0x80, 0x06, 0x0100, 0, 18, 1000, ctypes.addressof(buf))
+        fd = os.open(self.gun.usbfs, os.O_RDWR)
+        try:
+            while not self.stop.is_set():
+                try:
+                    fcntl.ioctl(fd, USBDEVFS_CONTROL, ctrl)
+                    self.usb_transfers += 1
+                except OSError:
+                    time.sleep(0.01)
+        finally:
+            os.close(fd)
+
+    def run(self):
+        args = self.args
+        mouse = self.gun.event_node("Mouse")
+        joystick = self.gun.event_node("Joystick")
+
+        if not self.gun.userspace:
+            try:
+                write_file(f"{self.gun.intf}/threaded", "1" if args.threaded else "0")
+            except OSError as err:
+                raise RuntimeError(f"can't select the processing path, is the gun open elsewhere? ({err})")
+            write_file(self.gun.debugfs("latency"), "0")
+
+        if args.reset_interval:
+            self.calibrate_resets()
+
+        hogs = [multiprocessing.Process(target=cpu_hog, args=(args.hog_priority,), daemon=True)
+                for _ in range(args.cpu_load)]
+        for hog in hogs:
+            hog.start()
+
+        threads = [threading.Thread(target=self.reader, args=(mouse,)),
+                   threading.Thread(target=self.writer)]
+        if args.probe:
+            threads.append(threading.Thread(target=self.open_probe, args=(joystick,)))
+        if args.reset_interval:
+            threads.append(threading.Thread(target=self.resetter))
+        if args.usb_load:
+            threads.append(threading.Thread(target=self.usb_load))
+
+        log.info(f"Running for {args.duration}s at {args.rate} reports/s, "
+                 f"{args.cpu_load} CPU hogs, usb load {'on' if args.usb_load else 'off'}")
+        for thread in threads:
+            thread.start()
+        try:
+            time.sleep(args.duration)
+        finally:
+            self.stop.set()
+            for thread in threads:
+                thread.join()
+            for hog in hogs:
+                hog.terminate()
+
+        if self.gun.userspace:
+            return self.report(self.gun.stop_userspace())
+        return self.report(read_file(self.gun.debugfs("latency")))
+
+    def excess_wait(self, start, end):
+        """
+        Part of an open() wait not explained by a reset: pre_reset holds
+        pm_mutex until post_reset by design, so an open() overlapping a reset
+        is only late by the time it still waited after that reset ended.
+        """
+        held_until = max((reset_end for reset_start, reset_end in self.resets
+                          if reset_start < end and reset_end > start), default=start)
+        return end - max(start, held_until)
+
+    def report(self, driver_latency):
+        latencies = sorted(self.latencies)
+        us = 1000.0
+        held = [end - start for start, end in self.open_waits
+                if any(reset_start < end and reset_end > start for reset_start, reset_end in self.resets)]
+        excess = [self.excess_wait(start, end) for start, end in self.open_waits]
+        limit = self.reset_limit or 0
+        stretched = [end - start for start, end in self.resets if limit and end - start > limit]
+        result = {
+            "kernel": platform.release(),
+            "preempt_rt": is_preempt_rt(),
+            "threaded": self.args.threaded,
+            "userspace": bool(self.gun.userspace),
+            "samples": len(latencies),
+            "lost": self.lost,
+            "latency_us": {
+                "min": latencies[0] / us if latencies else 0,
+                "p50": percentile(latencies, 50) / us,
+                "p99": percentile(latencies, 99) / us,
+                "p99.9": percentile(latencies, 99.9) / us,
+                "max": latencies[-1] / us if latencies else 0,
+            },
+            "resets": len(self.resets),
+            "reset_max_us": max((end - start for start, end in self.resets), default=0) / us,
+            "open_max_us": max((end - start for start, end in self.open_waits), default=0) / us,
+            # opens that waited for a reset to finish, the expected pm_mutex hold
+            "reset_holds": len(held),
+            "reset_hold_max_us": max(held, default=0) / us,
+            "reset_nominal_us": (self.reset_nominal or 0) / us,
+            "reset_limit_us": limit / us,
+            # resets stretched past the limit while holding pm_mutex, i.e. inversion on the reset path
+            "reset_stalls": len(stretched),
+            # waits beyond any reset, i.e. priority inversion elsewhere
+            "excess_max_us": max(excess, default=0) / us,
+            "stalls": (sum(1 for wait in excess if wait > self.args.stall_us * us) +
+                       sum(1 for wait in held if limit and wait > limit)),
+            "usb_transfers": self.usb_transfers,
+            "driver": {line.split()[0]: line.split()[1:] for line in driver_latency.splitlines()},
+        }
+        return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--duration", default=30.0, type=float, help="seconds to run")
+    parser.add_argument("--rate", default=500, type=int, help="reports per second written to the virtual gun")
+    parser.add_argument("--threaded", action="store_true", help="use the driver's threaded processing path")
+    parser.add_argument("--cpu-load", default=os.cpu_count(), type=int, help="number of busy-loop processes")
+    parser.add_argument("--hog-priority", default=0, type=int,
+                        help="run the busy loops as SCHED_FIFO at this priority (0: SCHED_OTHER)")
+    parser.add_argument("--usb-load", action="store_true", help="hammer the host controller with control transfers")
+    parser.add_argument("--reset-interval", default=5.0, type=float,
+                        help="seconds between USB port resets (0: never)")
+    parser.add_argument("--no-probe", dest="probe", action="store_false",
+                        help="don't reopen the joystick device to watch pm_mutex waits")
+    parser.add_argument("--probe-priority", default=90, type=int,
+                        help="SCHED_FIFO priority of the open() probe (0: SCHED_OTHER)")
+    parser.add_argument("--reset-us", default=None, type=float,
+                        help="resets longer than this count as stalls "
+                             "(default: unloaded reset time plus --stall-us, measured first)")
+    parser.add_argument("--stall-us", default=20000, type=int,
+                        help="open() waits longer than this, not counting the time a "
+                             "reset held pm_mutex, count as priority-inversion stalls; "
+                             "so do waits for a reset longer than the reset limit")
+    parser.add_argument("--max-latency-us", default=None, type=float,
+                        help="fail if the worst report-to-evdev latency exceeds this")
+    parser.add_argument("--userspace", metavar="GUNCON2D", default=None,
+                        help="drive the virtual gun with this userspace/guncon2d binary instead of the module")
+    parser.add_argument("--json", action="store_true", help="print the results as JSON")
+    args = parser.parse_args()
+
+    if args.userspace:
+        if args.threaded:
+            parser.error("--threaded selects a path of the kernel driver, not of guncon2d")
+        # resets would end guncon2d's session, and the probe watches the module's pm_mutex
+        args.reset_interval = 0
+        args.probe = False
+
+    logging.basicConfig(level=logging.INFO)
+
+    if os.geteuid() != 0:
+        sys.stderr.write("The latency harness must run as root\n")
+        return 1
+
+    with VirtualGun(args.userspace) as gun:
+        result = Harness(gun, args).run()
+
+    if args.json:
+        print(json.dumps(result, indent=2))
+    else:
+        lat = result["latency_us"]
+        print(f"kernel {result['kernel']} preempt_rt={result['preempt_rt']} threaded={result['threaded']} "
+              f"userspace={result['userspace']}")
+        print(f"samples={result['samples']} lost={result['lost']}")
+        print(f"latency us: min={lat['min']:.1f} p50={lat['p50']:.1f} p99={lat['p99']:.1f} "
+              f"p99.9={lat['p99.9']:.1f} max={lat['max']:.1f}")
+        print(f"resets={result['resets']} reset_max={result['reset_max_us']:.1f}us "
+              f"open_max={result['open_max_us']:.1f}us")
+        print(f"reset holds={result['reset_holds']} max={result['reset_hold_max_us']:.1f}us "
+              f"inversion excess_max={result['excess_max_us']:.1f}us stalls={result['stalls']}")
+        print(f"reset nominal={result['reset_nominal_us']:.1f}us limit={result['reset_limit_us']:.1f}us "
+              f"stretched={result['reset_stalls']}")
+        for path, values in result["driver"].items():
+            print(f"driver {path}: {' '.join(values)}")
+
+    if not result["samples"]:
+        return 1
+    if args.max_latency_us is not None and result["latency_us"]["max"] > args.max_latency_us:
+        return 1
+    if result["stalls"] or result["reset_stalls"]:
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main() or 0)
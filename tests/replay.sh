@@ -0,0 +1,14 @@
+#!/bin/sh
+# Replay every capture in tests/ and compare the fitted ranges with the
+# recorded expectation. Run from the repository root.
+status=0
+for cap in tests/*.cap; do
+    expected="${cap%.cap}.expected"
+    if python3 -B calibrate.py --replay "$cap" 2>/dev/null | grep -v '^runtime ' | diff -u "$expected" -; then
+        echo "ok   $cap"
+    else
+        echo "FAIL $cap"
+        status=1
+    fi
+done
+exit $status
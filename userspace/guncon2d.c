@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Userspace reference driver for the Namco GunCon 2 USB light gun
+ *
+ * Speaks the same protocol as guncon2.c through libusb asynchronous transfers
+ * and emits the same events through two uinput devices, so the kernel driver
+ * can be benchmarked against a userspace baseline on the same hardware.
+ * Only the base protocol is implemented: mode command, report decoding,
+ * invalid code filtering and offscreen hysteresis.
+ *
+ * On exit it prints the number of reports, the callback-to-uinput latency
+ * and the CPU time used. The latency starts when libusb runs the transfer
+ * callback, so unlike the kernel driver's completion-to-input_sync() counters
+ * it leaves out the usbfs reap and libusb's event dispatch; use
+ * latency_harness.py --userspace for a comparable end-to-end figure.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libusb.h>
+#include <linux/uinput.h>
+
+#define NAMCO_VENDOR_ID 0x0b9a
+#define GUNCON2_PRODUCT_ID 0x016a
+
+#define GUNCON2_DPAD_LEFT (1 << 15)
+#define GUNCON2_DPAD_RIGHT (1 << 13)
+#define GUNCON2_DPAD_UP (1 << 12)
+#define GUNCON2_DPAD_DOWN (1 << 14)
+#define GUNCON2_TRIGGER (1 << 5)
+#define GUNCON2_BTN_A (1 << 11)
+#define GUNCON2_BTN_B (1 << 10)
+#define GUNCON2_BTN_C (1 << 9)
+#define GUNCON2_BTN_START (1 << 7)
+#define GUNCON2_BTN_SELECT (1 << 6)
+
+// default calibration, same as the kernel driver
+#define X_MIN 175
+#define X_MAX 720
+#define Y_MIN 20
+#define Y_MAX 240
+
+#define OFFSCREEN_HYST_FRAMES 8
+
+#define GUNCON2_REPORT_SIZE 6
+#define GUNCON2_INTERFACE 0
+#define MAX_EVENTS 16
+
+struct guncon2 {
+    libusb_device_handle *handle;
+    struct libusb_transfer *transfer;
+    unsigned char buf[64];
+    int js_fd;
+    int mouse_fd;
+    uint16_t last_x;
+    uint16_t last_y;
+    bool have_last_pos;
+    int offscreen_frames;
+
+    /* benchmark counters */
+    unsigned long reports;
+    unsigned long long latency_total_ns;
+    unsigned long long latency_max_ns;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void on_signal(int sig)
+{
+    (void) sig;
+    running = 0;
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void push(struct input_event *events, int *n, int type, int code, int value)
+{
+    memset(&events[*n], 0, sizeof(events[*n]));
+    events[*n].type = type;
+    events[*n].code = code;
+    events[*n].value = value;
+    (*n)++;
+}
+
+static void flush(int fd, struct input_event *events, int n)
+{
+    push(events, &n, EV_SYN, SYN_REPORT, 0);
+    /* one write per packet, uinput accepts several events at once */
+    if (write(fd, events, n * sizeof(*events)) < 0)
+        perror("guncon2d: uinput write");
+}
+
+/* Mirrors guncon2_process() in the kernel driver, without the optional modes */
+static void guncon2_process(struct guncon2 *guncon2, const unsigned char *data)
+{
+    struct input_event js[MAX_EVENTS];
+    struct input_event mou[MAX_EVENTS];
+    int njs = 0, nmou = 0;
+    uint16_t raw_x, raw_y;
+    int buttons;
+    int hat_x = 0, hat_y = 0;
+    bool invalid_coords = false;
+    bool offscreen;
+
+    /* Aiming: 2 bytes buttons, 2 bytes X, 1 byte Y, 1 byte extra */
+    raw_x = (data[3] << 8) | data[2];
+    raw_y = data[4];
+
+    /* same special codes and range as the kernel driver */
+    if (raw_x == 1 && (raw_y == 5 || raw_y == 10))
+        invalid_coords = true;
+    else if (raw_x == 0 && raw_y == 0)
+        invalid_coords = true;
+    else if (raw_x < X_MIN || raw_x > X_MAX ||
+             raw_y < Y_MIN || raw_y > Y_MAX)
+        invalid_coords = true;
+
+    if (invalid_coords)
+        guncon2->offscreen_frames++;
+    else
+        guncon2->offscreen_frames = 0;
+    offscreen = guncon2->offscreen_frames >= OFFSCREEN_HYST_FRAMES;
+
+    if (!invalid_coords) {
+        guncon2->last_x = raw_x;
+        guncon2->last_y = raw_y;
+        guncon2->have_last_pos = true;
+    }
+
+    /* Always report last good known position */
+    if (guncon2->have_last_pos) {
+        push(js, &njs, EV_ABS, ABS_X, guncon2->last_x);
+        push(js, &njs, EV_ABS, ABS_Y, guncon2->last_y);
+        push(mou, &nmou, EV_ABS, ABS_X, guncon2->last_x);
+        push(mou, &nmou, EV_ABS, ABS_Y, guncon2->last_y);
+    }
+
+    /* Buttons */
+    buttons = ((data[0] << 8) | data[1]) ^ 0xffff;
+
+    if (buttons & GUNCON2_DPAD_LEFT)
+        hat_x -= 1;
+    if (buttons & GUNCON2_DPAD_RIGHT)
+        hat_x += 1;
+    if (buttons & GUNCON2_DPAD_UP)
+        hat_y -= 1;
+    if (buttons & GUNCON2_DPAD_DOWN)
+        hat_y += 1;
+
+    push(js, &njs, EV_ABS, ABS_HAT0X, hat_x);
+    push(js, &njs, EV_ABS, ABS_HAT0Y, hat_y);
+
+    push(js, &njs, EV_KEY, BTN_TRIGGER, !!(buttons & GUNCON2_TRIGGER));
+    push(js, &njs, EV_KEY, BTN_A, !!(buttons & GUNCON2_BTN_A));
+    push(js, &njs, EV_KEY, BTN_B, !!(buttons & GUNCON2_BTN_B));
+    push(js, &njs, EV_KEY, BTN_C, !!(buttons & GUNCON2_BTN_C));
+    push(js, &njs, EV_KEY, BTN_START, !!(buttons & GUNCON2_BTN_START));
+    push(js, &njs, EV_KEY, BTN_SELECT, !!(buttons & GUNCON2_BTN_SELECT));
+    push(js, &njs, EV_KEY, BTN_Z, offscreen);
+
+    push(mou, &nmou, EV_KEY, BTN_LEFT, !!(buttons & GUNCON2_TRIGGER));
+    push(mou, &nmou, EV_KEY, BTN_RIGHT, !!(buttons & (GUNCON2_BTN_A | GUNCON2_BTN_C)));
+    push(mou, &nmou, EV_KEY, BTN_MIDDLE, !!(buttons & GUNCON2_BTN_B));
+    push(mou, &nmou, EV_KEY, BTN_EXTRA, offscreen);
+
+    flush(guncon2->js_fd, js, njs);
+    flush(guncon2->mouse_fd, mou, nmou);
+}
+
+static void LIBUSB_CALL guncon2_usb_irq(struct libusb_transfer *transfer)
+{
+    struct guncon2 *guncon2 = transfer->user_data;
+    /* callback entry, the URB completed earlier in the kernel */
+    unsigned long long start_ns = now_ns();
+    unsigned long long latency_ns;
+    int error;
+
+    switch (transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            break;
+        case LIBUSB_TRANSFER_CANCELLED:
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            running = 0;
+            return;
+        default:
+            goto exit;
+    }
+
+    if (transfer->actual_length == GUNCON2_REPORT_SIZE) {
+        guncon2_process(guncon2, transfer->buffer);
+
+        latency_ns = now_ns() - start_ns;
+        guncon2->reports++;
+        guncon2->latency_total_ns += latency_ns;
+        if (latency_ns > guncon2->latency_max_ns)
+            guncon2->latency_max_ns = latency_ns;
+    }
+
+exit:
+    /* Resubmit to fetch new fresh reports */
+    error = libusb_submit_transfer(transfer);
+    if (error) {
+        fprintf(stderr, "guncon2d: resubmit failed: %s\n", libusb_error_name(error));
+        running = 0;
+    }
+}
+
+static int uinput_abs(int fd, int code, int min, int max)
+{
+    struct uinput_abs_setup abs = {.code = code};
+
+    abs.absinfo.minimum = min;
+    abs.absinfo.maximum = max;
+    if (ioctl(fd, UI_SET_ABSBIT, code) < 0)
+        return -1;
+    return ioctl(fd, UI_ABS_SETUP, &abs);
+}
+
+static int uinput_create(const char *name, const int *keys, int nkeys, bool hat)
+{
+    struct uinput_setup setup = {0};
+    int fd, i;
+
+    fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0 ||
+        ioctl(fd, UI_SET_EVBIT, EV_ABS) < 0 ||
+        ioctl(fd, UI_SET_PHYS, "guncon2d/input0") < 0)
+        goto err;
+
+    for (i = 0; i < nkeys; i++)
+        if (ioctl(fd, UI_SET_KEYBIT, keys[i]) < 0)
+            goto err;
+
+    if (uinput_abs(fd, ABS_X, X_MIN, X_MAX) < 0 ||
+        uinput_abs(fd, ABS_Y, Y_MIN, Y_MAX) < 0)
+        goto err;
+    if (hat && (uinput_abs(fd, ABS_HAT0X, -1, 1) < 0 ||
+                uinput_abs(fd, ABS_HAT0Y, -1, 1) < 0))
+        goto err;
+
+    setup.id.bustype = BUS_USB;
+    setup.id.vendor = NAMCO_VENDOR_ID;
+    setup.id.product = GUNCON2_PRODUCT_ID;
+    snprintf(setup.name, sizeof(setup.name), "%s", name);
+    if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0)
+        goto err;
+
+    return fd;
+
+err:
+    close(fd);
+    return -1;
+}
+
+static int guncon2_find_endpoint(libusb_device_handle *handle, unsigned char *ep,
+                                 int *maxp)
+{
+    struct libusb_config_descriptor *config;
+    const struct libusb_interface_descriptor *alt;
+    int i, error;
+
+    error = libusb_get_active_config_descriptor(libusb_get_device(handle), &config);
+    if (error)
+        return error;
+
+    error = LIBUSB_ERROR_NOT_FOUND;
+    alt = &config->interface[GUNCON2_INTERFACE].altsetting[0];
+    for (i = 0; i < alt->bNumEndpoints; i++) {
+        const struct libusb_endpoint_descriptor *desc = &alt->endpoint[i];
+
+        if ((desc->bmAttributes & LIBUSB_TRANSFER_TYPE_MASK) == LIBUSB_TRANSFER_TYPE_INTERRUPT &&
+            (desc->bEndpointAddress & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN) {
+            *ep = desc->bEndpointAddress;
+            *maxp = desc->wMaxPacketSize;
+            error = 0;
+            break;
+        }
+    }
+
+    libusb_free_config_descriptor(config);
+    return error;
+}
+
+static void print_stats(const struct guncon2 *guncon2)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("reports %lu\n", guncon2->reports);
+    printf("callback avg_ns %llu max_ns %llu\n",
+           guncon2->reports ? guncon2->latency_total_ns / guncon2->reports : 0,
+           guncon2->latency_max_ns);
+    printf("cpu user_us %ld sys_us %ld\n",
+           usage.ru_utime.tv_sec * 1000000L + usage.ru_utime.tv_usec,
+           usage.ru_stime.tv_sec * 1000000L + usage.ru_stime.tv_usec);
+}
+
+int main(void)
+{
+    static const int js_keys[] = {BTN_TRIGGER, BTN_A, BTN_B, BTN_C,
+                                  BTN_START, BTN_SELECT, BTN_Z};
+    static const int mouse_keys[] = {BTN_LEFT, BTN_RIGHT, BTN_MIDDLE, BTN_EXTRA};
+    struct guncon2 guncon2 = {.js_fd = -1, .mouse_fd = -1};
+    /* set the mode to normal 50Hz mode, as guncon2_open() does */
+    unsigned char gmode[6] = {0, 0, 0, 0, 0, 1};
+    unsigned char ep;
+    int maxp, error, ret = 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    error = libusb_init(NULL);
+    if (error) {
+        fprintf(stderr, "guncon2d: libusb_init: %s\n", libusb_error_name(error));
+        return 1;
+    }
+
+    guncon2.handle = libusb_open_device_with_vid_pid(NULL, NAMCO_VENDOR_ID, GUNCON2_PRODUCT_ID);
+    if (!guncon2.handle) {
+        fprintf(stderr, "guncon2d: no GunCon 2 found\n");
+        goto out_exit;
+    }
+
+    /* take the gun over from the kernel driver for the duration of the run */
+    libusb_set_auto_detach_kernel_driver(guncon2.handle, 1);
+    error = libusb_claim_interface(guncon2.handle, GUNCON2_INTERFACE);
+    if (error) {
+        fprintf(stderr, "guncon2d: claim interface: %s\n", libusb_error_name(error));
+        goto out_close;
+    }
+
+    error = guncon2_find_endpoint(guncon2.handle, &ep, &maxp);
+    if (error || maxp > (int) sizeof(guncon2.buf)) {
+        fprintf(stderr, "guncon2d: could not find endpoint\n");
+        goto out_release;
+    }
+
+    guncon2.mouse_fd = uinput_create("Namco GunCon 2 Mouse", mouse_keys,
+                                     sizeof(mouse_keys) / sizeof(mouse_keys[0]), false);
+    guncon2.js_fd = uinput_create("Namco GunCon 2 Joystick", js_keys,
+                                  sizeof(js_keys) / sizeof(js_keys[0]), true);
+    if (guncon2.mouse_fd < 0 || guncon2.js_fd < 0) {
+        perror("guncon2d: uinput");
+        goto out_uinput;
+    }
+
+    libusb_control_transfer(guncon2.handle, 0x21, 0x09, 0x200, 0, gmode, sizeof(gmode), 100000);
+
+    guncon2.transfer = libusb_alloc_transfer(0);
+    if (!guncon2.transfer)
+        goto out_uinput;
+
+    libusb_fill_interrupt_transfer(guncon2.transfer, guncon2.handle, ep, guncon2.buf, maxp,
+                                   guncon2_usb_irq, &guncon2, 0);
+    error = libusb_submit_transfer(guncon2.transfer);
+    if (error) {
+        fprintf(stderr, "guncon2d: submit failed: %s\n", libusb_error_name(error));
+        goto out_transfer;
+    }
+
+    while (running) {
+        error = libusb_handle_events(NULL);
+        if (error && error != LIBUSB_ERROR_INTERRUPTED) {
+            fprintf(stderr, "guncon2d: handle events: %s\n", libusb_error_name(error));
+            break;
+        }
+    }
+
+    /* wait for the cancellation to complete before freeing the transfer */
+    if (libusb_cancel_transfer(guncon2.transfer) == 0) {
+        running = 1;
+        while (running)
+            libusb_handle_events(NULL);
+    }
+
+    print_stats(&guncon2);
+    ret = 0;
+
+out_transfer:
+    libusb_free_transfer(guncon2.transfer);
+out_uinput:
+    if (guncon2.js_fd >= 0) {
+        ioctl(guncon2.js_fd, UI_DEV_DESTROY);
+        close(guncon2.js_fd);
+    }
+    if (guncon2.mouse_fd >= 0) {
+        ioctl(guncon2.mouse_fd, UI_DEV_DESTROY);
+        close(guncon2.mouse_fd);
+    }
+out_release:
+    libusb_release_interface(guncon2.handle, GUNCON2_INTERFACE);
+out_close:
+    libusb_close(guncon2.handle);
+out_exit:
+    libusb_exit(NULL);
+    return ret;
+}